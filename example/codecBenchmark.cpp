@@ -0,0 +1,251 @@
+/**
+ * Codec and framing benchmark for host builds. Times the hot paths of the
+ * library and prints one CSV line per case:
+ *
+ *   label,name,iterations,ns_per_op,bytes_per_sec
+ *
+ *   - crc16 over 256 bytes
+ *   - the buffer_append_* / buffer_get_* functions
+ *   - packSendPayload() framing of a request
+ *   - receiveUartMessage() receive and unpack of one reply frame
+ *   - the float package decoders, one per command
+ *   - whole requests through the public calls
+ *
+ * RepeatStream plays a recorded reply frame back, for every read in the
+ * receive cases and once per request in the request cases, so no VESC is
+ * needed and the numbers are the library's own cost. Each case keeps the
+ * best of five rounds. Build it the same way for two library versions and
+ * diff the output, the label tells the runs apart.
+ */
+
+// g++ -std=gnu++11 -O2 -Isrc/host -Isrc example/codecBenchmark.cpp src/*.cpp -o codecBenchmark
+// ./codecBenchmark v1.0.1 [iterations]
+
+#include "VescHost.h"
+#include <algorithm>
+
+// Framing, receive and the decoders are private
+#define private public
+#include "VescUart.h"
+#undef private
+
+static VescUart UART(100);
+static RepeatStream replay;
+static const char *label = "current";
+static uint32_t iterations = 2000000;
+
+static uint8_t scratch[256];
+static volatile uint32_t sink;
+
+/** Frame a float package reply: COMM_CUSTOM_APP_DATA, magic number, command, fields */
+static size_t makeReply(uint8_t *frame, uint8_t command, const uint8_t *fields, int32_t len)
+{
+	uint8_t payload[64];
+	int32_t index = 0;
+	payload[index++] = COMM_CUSTOM_APP_DATA;
+	payload[index++] = ESP32_COMMAND_ID;
+	payload[index++] = command;
+	memcpy(payload + index, fields, len);
+	index += len;
+
+	uint16_t crc = crc16(payload, index);
+	size_t count = 0;
+	frame[count++] = 2;
+	frame[count++] = index;
+	memcpy(frame + count, payload, index);
+	count += index;
+	frame[count++] = (uint8_t)(crc >> 8);
+	frame[count++] = (uint8_t)(crc & 0xFF);
+	frame[count++] = 3;
+	return count;
+}
+
+/** Best of five rounds of n calls; bytes is what one call moves */
+template <typename F>
+static void bench(const char *name, uint32_t n, uint32_t bytes, F body)
+{
+	double best = 1e18;
+	for (int round = 0; round < 5; round++)
+	{
+		uint64_t start = vesc_host_clock().now_us();
+		for (uint32_t i = 0; i < n; i++)
+			body(i);
+		best = std::min(best, (double)(vesc_host_clock().now_us() - start));
+	}
+
+	double ns = best * 1000.0 / n;
+	double rate = best > 0 ? (double)bytes * n * 1e6 / best : 0;
+	printf("%s,%s,%u,%.2f,%.0f\n", label, name, (unsigned)n, ns, rate);
+}
+
+static void benchCrc(void)
+{
+	for (int i = 0; i < 256; i++)
+		scratch[i] = i * 7;
+
+	bench("crc16_256", iterations / 20, 256, [](uint32_t) { sink += crc16(scratch, 256); });
+}
+
+static void benchBuffer(void)
+{
+	uint32_t n = iterations * 5;
+
+	bench("append_float32_auto", n, 4, [](uint32_t i) {
+		int32_t index = 0;
+		buffer_append_float32_auto(scratch, i * 0.37f, &index);
+		sink += scratch[0];
+	});
+	bench("get_float32_auto", n, 4, [](uint32_t) {
+		int32_t index = 0;
+		sink += (uint32_t)buffer_get_float32_auto(scratch, &index);
+	});
+	bench("append_float32", n, 4, [](uint32_t i) {
+		int32_t index = 0;
+		buffer_append_float32(scratch, i * 0.37f, 1e2, &index);
+		sink += scratch[0];
+	});
+	bench("get_float32", n, 4, [](uint32_t) {
+		int32_t index = 0;
+		sink += (uint32_t)buffer_get_float32(scratch, 1e2, &index);
+	});
+	bench("append_float16", n, 2, [](uint32_t i) {
+		int32_t index = 0;
+		buffer_append_float16(scratch, i * 0.01f, 1e2, &index);
+		sink += scratch[0];
+	});
+	bench("get_float16", n, 2, [](uint32_t) {
+		int32_t index = 0;
+		sink += (uint32_t)buffer_get_float16(scratch, 1e2, &index);
+	});
+	bench("varint_roundtrip", n, 3, [](uint32_t i) {
+		int32_t index = 0;
+		buffer_append_varint(scratch, (int32_t)i - 10000, &index);
+		index = 0;
+		sink += buffer_get_varint(scratch, 5, &index);
+	});
+}
+
+static void benchFraming(void)
+{
+	static uint8_t payload[64];
+	for (int i = 0; i < 64; i++)
+		payload[i] = i;
+
+	bench("pack_send_3", iterations, 3 + 5, [](uint32_t) { sink += UART.packSendPayload(payload, 3); });
+	bench("pack_send_64", iterations, 64 + 5, [](uint32_t) { sink += UART.packSendPayload(payload, 64); });
+}
+
+struct decodeCase_t
+{
+	const char *receive;
+	const char *decode;
+	const char *request;
+	uint8_t command;
+	bool (VescUart::*decoder)(uint8_t *message, int lenPay);
+	bool (*call)(void);
+};
+
+static bool soundRequest(void) { return UART.soundUpdate(); }
+static bool advancedRequest(void) { return UART.advancedUpdate(); }
+static bool triggeredRequest(void) { return UART.get_sound_triggered() == 1; }
+static bool bundleRequest(void) { return UART.bundleUpdate(); }
+static bool compactRequest(void) { return UART.soundUpdate(); }
+
+static void benchDecode(void)
+{
+	uint8_t fields[32];
+	int32_t index;
+	static uint8_t frames[5][64];
+	size_t lengths[5];
+
+	// pidOutput, swState, erpm, inputVoltage, motorCurrent
+	index = 0;
+	buffer_append_float32_auto(fields, 12.5f, &index);
+	fields[index++] = 2;
+	buffer_append_float32_auto(fields, 3200.0f, &index);
+	buffer_append_float32_auto(fields, 50.4f, &index);
+	buffer_append_float32_auto(fields, 8.2f, &index);
+	lengths[0] = makeReply(frames[0], ESP_COMMAND_ENGINE_SOUND_INFO, fields, index);
+
+	// The bundle is the sound info followed by soundTriggered and enableItemData
+	fields[index++] = 1;
+	fields[index++] = 0x05;
+	lengths[1] = makeReply(frames[1], ESP_COMMAND_GET_BUNDLE, fields, index);
+
+	// lights, idle warning, volume, over speed, battery, low battery, sampling
+	index = 0;
+	fields[index++] = 1;
+	fields[index++] = 30;
+	buffer_append_uint16(fields, 80, &index);
+	fields[index++] = 1;
+	buffer_append_float32_auto(fields, 0.76f, &index);
+	fields[index++] = 20;
+	fields[index++] = 1;
+	lengths[2] = makeReply(frames[2], ESP_COMMAND_GET_ADV_INFO, fields, index);
+
+	fields[0] = 1;
+	lengths[3] = makeReply(frames[3], ESP_COMMAND_SOUND_GET, fields, 1);
+
+	// float16 pidOutput, swState, varint erpm, float16 voltage and current
+	index = 0;
+	buffer_append_float16(fields, 12.5f, 1e2, &index);
+	fields[index++] = 2;
+	buffer_append_varint(fields, 3200, &index);
+	buffer_append_float16(fields, 50.4f, 1e2, &index);
+	buffer_append_float16(fields, 8.2f, 1e1, &index);
+	lengths[4] = makeReply(frames[4], ESP_COMMAND_ENGINE_SOUND_COMPACT, fields, index);
+
+	const decodeCase_t cases[] = {
+		{"receive_sound_info", "decode_sound_info", "sound_info_request", ESP_COMMAND_ENGINE_SOUND_INFO, &VescUart::soundDecode, soundRequest},
+		{"receive_bundle", "decode_bundle", "bundle_request", ESP_COMMAND_GET_BUNDLE, &VescUart::bundleDecode, bundleRequest},
+		{"receive_adv_info", "decode_adv_info", "adv_info_request", ESP_COMMAND_GET_ADV_INFO, &VescUart::advancedDecode, advancedRequest},
+		{"receive_sound_get", "decode_sound_get", "sound_get_request", ESP_COMMAND_SOUND_GET, &VescUart::soundTriggeredDecode, triggeredRequest},
+		{"receive_sound_compact", "decode_sound_compact", "sound_compact_request", ESP_COMMAND_ENGINE_SOUND_COMPACT, &VescUart::soundDecodeCompact, compactRequest},
+	};
+
+	// bundleUpdate() asks for the handshake first, answer it once
+	uint8_t ready[4] = {1, 1, 0, ESP_CAP_BUNDLE | ESP_CAP_SOUND_COMPACT};
+	uint8_t readyFrame[32];
+	replay.setFrame(readyFrame, makeReply(readyFrame, ESP_COMMAND_GET_READY, ready, sizeof(ready)), true);
+	UART.get_vesc_ready();
+
+	for (size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); c++)
+	{
+		static decodeCase_t current;
+		static uint8_t message[256];
+		static int messageLength;
+
+		current = cases[c];
+		replay.setFrame(frames[c], lengths[c]);
+		UART.setSoundCompact(current.command == ESP_COMMAND_ENGINE_SOUND_COMPACT);
+
+		bench(current.receive, iterations, lengths[c], [](uint32_t) {
+			messageLength = UART.receiveUartMessage(message);
+			sink += messageLength;
+		});
+		bench(current.decode, iterations * 5, messageLength, [](uint32_t) {
+			sink += (UART.*current.decoder)(message, messageLength);
+		});
+
+		// One reply per request from here on, as from a VESC
+		replay.setFrame(frames[c], lengths[c], true);
+		bench(current.request, iterations, lengths[c] + 8, [](uint32_t) { sink += current.call(); });
+	}
+}
+
+int main(int argc, char **argv)
+{
+	if (argc > 1)
+		label = argv[1];
+	if (argc > 2)
+		iterations = atoi(argv[2]);
+
+	UART.setSerialPort(&replay);
+
+	printf("label,name,iterations,ns_per_op,bytes_per_sec\n");
+	benchCrc();
+	benchBuffer();
+	benchFraming();
+	benchDecode();
+	return 0;
+}
@@ -0,0 +1,176 @@
+/**
+ * Request engine benchmark for host builds: every float package command is
+ * timed through the espCommands engine (the public calls) and through a
+ * hand-written path doing what the per-command functions did before the
+ * table: build the 3-byte payload, send it, receive, check the fixed reply
+ * length and call the decoder directly.
+ *
+ * RepeatStream plays a recorded reply back for every request, so both sides
+ * measure the library alone: framing, CRC, receive, lookup and decode.
+ *
+ *   label,command,path,iterations,ns_per_request
+ *
+ * followed by one overhead line per command with the engine's extra cost,
+ * taken from the best of eight alternating rounds of each path.
+ */
+
+// g++ -std=gnu++11 -O2 -Isrc/host -Isrc example/engineBenchmark.cpp src/*.cpp -o engineBenchmark
+// ./engineBenchmark [label] [iterations]
+
+#include "VescHost.h"
+#include <algorithm>
+
+// The hand-written paths need the private send, receive and decoders
+#define private public
+#include "VescUart.h"
+#undef private
+
+static VescUart UART(100);
+static RepeatStream replay;
+static volatile uint32_t sink;
+
+struct case_t
+{
+	const char *name;
+	esp_commands command;
+	bool (*engine)(void);
+	bool (VescUart::*decode)(uint8_t *message, int lenPay);
+	int length;			// reply length the hand-written path expects
+};
+
+static bool soundEngine(void) { return UART.soundUpdate(); }
+static bool advancedEngine(void) { return UART.advancedUpdate(); }
+static bool triggeredEngine(void) { return UART.get_sound_triggered() == 1; }
+static bool enableEngine(void) { return UART.get_enable_item_data() == 5; }
+static bool bundleEngine(void) { return UART.bundleUpdate(); }
+static bool readyEngine(void) { return UART.get_vesc_ready(); }
+
+static bool handWritten(const case_t &c)
+{
+	uint8_t payload[3] = {COMM_CUSTOM_APP_DATA, ESP32_COMMAND_ID, (uint8_t)c.command};
+	UART.packSendPayload(payload, sizeof(payload));
+
+	uint8_t message[256];
+	int messageLength = UART.receiveUartMessage(message);
+
+	if (messageLength != c.length || message[2] != c.command)
+		return false;
+	return (UART.*c.decode)(message, messageLength);
+}
+
+/** Frame a float package reply: COMM_CUSTOM_APP_DATA, magic number, command, fields */
+static size_t makeReply(uint8_t *frame, uint8_t command, const uint8_t *fields, int32_t len)
+{
+	uint8_t payload[64];
+	int32_t index = 0;
+	payload[index++] = COMM_CUSTOM_APP_DATA;
+	payload[index++] = ESP32_COMMAND_ID;
+	payload[index++] = command;
+	memcpy(payload + index, fields, len);
+	index += len;
+
+	uint16_t crc = crc16(payload, index);
+	size_t count = 0;
+	frame[count++] = 2;
+	frame[count++] = index;
+	memcpy(frame + count, payload, index);
+	count += index;
+	frame[count++] = (uint8_t)(crc >> 8);
+	frame[count++] = (uint8_t)(crc & 0xFF);
+	frame[count++] = 3;
+	return count;
+}
+
+static double timeRequests(bool (*engine)(void), const case_t *c, uint32_t n)
+{
+	uint32_t ok = 0;
+	uint64_t start = vesc_host_clock().now_us();
+	for (uint32_t i = 0; i < n; i++)
+		ok += engine != NULL ? engine() : handWritten(*c);
+	uint64_t elapsed = vesc_host_clock().now_us() - start;
+
+	sink += ok;
+	if (ok != n)
+		fprintf(stderr, "%s: %u of %u requests failed\n", c->name, (unsigned)(n - ok), (unsigned)n);
+	return elapsed * 1000.0 / n;
+}
+
+int main(int argc, char **argv)
+{
+	const char *label = argc > 1 ? argv[1] : "current";
+	uint32_t n = argc > 2 ? atoi(argv[2]) : 200000;
+
+	UART.setSerialPort(&replay);
+
+	uint8_t fields[32];
+	uint8_t frames[6][64];
+	size_t lengths[6];
+	int32_t index;
+
+	// ready, protocol 1, bundle capability; the handshake bundleUpdate() needs
+	index = 0;
+	fields[index++] = 1;
+	fields[index++] = 1;
+	buffer_append_uint16(fields, ESP_CAP_BUNDLE, &index);
+	lengths[0] = makeReply(frames[0], ESP_COMMAND_GET_READY, fields, index);
+
+	// pidOutput, swState, erpm, inputVoltage, motorCurrent
+	index = 0;
+	buffer_append_float32_auto(fields, 12.5f, &index);
+	fields[index++] = 2;
+	buffer_append_float32_auto(fields, 3200.0f, &index);
+	buffer_append_float32_auto(fields, 50.4f, &index);
+	buffer_append_float32_auto(fields, 8.2f, &index);
+	lengths[1] = makeReply(frames[1], ESP_COMMAND_ENGINE_SOUND_INFO, fields, index);
+
+	// The bundle is the sound info followed by soundTriggered and enableItemData
+	fields[index++] = 1;
+	fields[index++] = 5;
+	lengths[2] = makeReply(frames[2], ESP_COMMAND_GET_BUNDLE, fields, index);
+
+	// lights, idle warning, volume, over speed, battery, low battery, sampling
+	index = 0;
+	fields[index++] = 1;
+	fields[index++] = 30;
+	buffer_append_uint16(fields, 80, &index);
+	fields[index++] = 1;
+	buffer_append_float32_auto(fields, 0.76f, &index);
+	fields[index++] = 20;
+	fields[index++] = 1;
+	lengths[3] = makeReply(frames[3], ESP_COMMAND_GET_ADV_INFO, fields, index);
+
+	fields[0] = 1;
+	lengths[4] = makeReply(frames[4], ESP_COMMAND_SOUND_GET, fields, 1);
+	fields[0] = 5;
+	lengths[5] = makeReply(frames[5], ESP_COMMAND_ENABLE_ITEM_INFO, fields, 1);
+
+	const case_t cases[] = {
+		{"ready", ESP_COMMAND_GET_READY, readyEngine, &VescUart::readyDecode, 7},
+		{"sound_info", ESP_COMMAND_ENGINE_SOUND_INFO, soundEngine, &VescUart::soundDecode, 20},
+		{"bundle", ESP_COMMAND_GET_BUNDLE, bundleEngine, &VescUart::bundleDecode, 22},
+		{"adv_info", ESP_COMMAND_GET_ADV_INFO, advancedEngine, &VescUart::advancedDecode, 14},
+		{"sound_get", ESP_COMMAND_SOUND_GET, triggeredEngine, &VescUart::soundTriggeredDecode, 4},
+		{"enable_item", ESP_COMMAND_ENABLE_ITEM_INFO, enableEngine, &VescUart::enableItemDecode, 4},
+	};
+
+	printf("label,command,path,iterations,ns_per_request\n");
+	for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++)
+	{
+		replay.setFrame(frames[i], lengths[i], true);
+
+		// Alternate the two paths so drift in the machine hits both alike, and
+		// keep the best round of each: the rest is scheduling noise
+		double engine = 1e9, hand = 1e9;
+		for (int round = 0; round < 8; round++)
+		{
+			engine = std::min(engine, timeRequests(cases[i].engine, &cases[i], n / 8));
+			hand = std::min(hand, timeRequests(NULL, &cases[i], n / 8));
+		}
+
+		printf("%s,%s,engine,%u,%.1f\n", label, cases[i].name, (unsigned)n, engine);
+		printf("%s,%s,hand_written,%u,%.1f\n", label, cases[i].name, (unsigned)n, hand);
+		printf("%s,%s,overhead,%u,%.1f\n", label, cases[i].name, (unsigned)n, engine - hand);
+	}
+
+	return 0;
+}
@@ -0,0 +1,157 @@
+/**
+ * File transfer benchmark for host builds: fileWrite() and fileRead() move a
+ * file to and from a simulated VESC file system behind VescSimPeer at several
+ * baud rates, and the rate in KB/s of simulated time is reported per
+ * direction. Both sides are checked against the reference afterwards.
+ *
+ * The optional fault rate (per 1000 replies, dropped or corrupted) exercises
+ * the resend of the window.
+ */
+
+// g++ -std=gnu++11 -O2 -Isrc/host -Isrc example/fileBenchmark.cpp src/*.cpp -o fileBenchmark
+// ./fileBenchmark [label] [file KB] [faults per 1000] [read chunk]
+
+#include "VescSimPeer.h"
+
+#define FILE_MAX (1024 * 1024)
+
+struct filesystem_t
+{
+	uint8_t data[FILE_MAX];
+	uint32_t size;
+	uint32_t chunk;		// bytes per COMM_FILE_READ reply
+	uint32_t requests;
+};
+
+/** Print that keeps what was written, for the downloaded copy */
+class MemoryPrint : public Print
+{
+public:
+	uint8_t data[FILE_MAX];
+	uint32_t size = 0;
+
+	size_t write(uint8_t c) override { return write(&c, 1); }
+	size_t write(const uint8_t *buffer, size_t len) override
+	{
+		if (size + len > sizeof(data))
+			len = sizeof(data) - size;
+		memcpy(data + size, buffer, len);
+		size += len;
+		return len;
+	}
+
+	using Print::write;
+};
+
+static filesystem_t fs;
+static MemoryPrint download;
+static LoopbackStream<FILE_MAX> upload;
+static uint8_t reference[FILE_MAX];
+
+static bool serveFiles(void *context, const uint8_t *payload, size_t len, uint8_t *reply, int32_t *index)
+{
+	filesystem_t *f = (filesystem_t *)context;
+
+	if (payload[0] != COMM_FILE_READ && payload[0] != COMM_FILE_WRITE)
+		return false;
+
+	// Path first, a single file is served whatever its name
+	int32_t i = 1 + strnlen((const char *)payload + 1, len - 1) + 1;
+	if (i + 4 > (int32_t)len)
+		return false;
+
+	uint32_t offset = buffer_get_int32(payload, &i);
+	f->requests++;
+
+	if (payload[0] == COMM_FILE_READ)
+	{
+		uint32_t n = offset < f->size ? f->size - offset : 0;
+		if (n > f->chunk)
+			n = f->chunk;
+		buffer_append_int32(reply, offset, index);
+		buffer_append_int32(reply, f->size, index);
+		memcpy(reply + *index, f->data + offset, n);
+		*index += n;
+		return true;
+	}
+
+	uint32_t size = buffer_get_int32(payload, &i);
+	uint32_t n = len - i;
+	bool ok = size <= sizeof(f->data) && offset + n <= size;
+	if (ok)
+	{
+		memcpy(f->data + offset, payload + i, n);
+		f->size = size;
+	}
+	buffer_append_int32(reply, offset, index);
+	reply[(*index)++] = ok;
+	return true;
+}
+
+int main(int argc, char **argv)
+{
+	const char *label = argc > 1 ? argv[1] : "current";
+	uint32_t size = (argc > 2 ? atoi(argv[2]) : 64) * 1024;
+	uint16_t rate = argc > 3 ? atoi(argv[3]) : 0;
+	uint32_t chunk = argc > 4 ? atoi(argv[4]) : 400;
+	static const uint32_t bauds[] = {115200, 230400, 460800, 921600, 2000000};
+
+	// The reply carries 9 bytes in front of the data, fileRead() takes 512
+	if (size == 0 || size > FILE_MAX || chunk == 0 || chunk > 503)
+		return 1;
+
+	for (uint32_t i = 0; i < size; i++)
+		reference[i] = (uint8_t)(i * 2654435761u >> 11);
+	uint16_t crc = crc16(reference, size);
+
+	VirtualClock::install(0, 1);
+
+	printf("label,direction,baud,file_bytes,ok,verified,requests,seconds,kbytes_per_s\n");
+	for (size_t b = 0; b < sizeof(bauds) / sizeof(bauds[0]); b++)
+	{
+		VescSimPeer peer(bauds[b], 100);
+		peer.setHandler(serveFiles, &fs);
+
+		VescSimPeer::faults_t faults = {};
+		faults.drop = rate / 2;
+		faults.corrupt = rate - rate / 2;
+		peer.setFaults(faults, 1 + b);
+
+		VescUart vesc(100);
+		vesc.setSerialPort(peer.port());
+
+		memset(&fs, 0, sizeof(fs));
+		fs.chunk = chunk;
+		upload.write(reference, size);
+
+		uint64_t start = vesc_host_clock().now_us();
+		bool ok = vesc.fileWrite("/bench.bin", &upload, size);
+		double seconds = (vesc_host_clock().now_us() - start) / 1e6;
+		bool verified = ok && fs.size == size && vesc.get_file_crc() == crc &&
+						memcmp(fs.data, reference, size) == 0;
+
+		printf("%s,write,%u,%u,%d,%d,%u,%.3f,%.1f\n", label, (unsigned)bauds[b], (unsigned)size, ok, verified,
+			   (unsigned)fs.requests, seconds, ok ? size / 1024.0 / seconds : 0.0);
+
+		// Drop what is left of the file after a failed upload, then read back
+		// the reference whatever the upload did
+		uint8_t scratch[256];
+		while (upload.available())
+			upload.readBytes(scratch, sizeof(scratch));
+		memcpy(fs.data, reference, size);
+		fs.size = size;
+		fs.requests = 0;
+		download.size = 0;
+
+		start = vesc_host_clock().now_us();
+		ok = vesc.fileRead("/bench.bin", &download);
+		seconds = (vesc_host_clock().now_us() - start) / 1e6;
+		verified = ok && download.size == size && vesc.get_file_crc() == crc &&
+				   memcmp(download.data, reference, size) == 0;
+
+		printf("%s,read,%u,%u,%d,%d,%u,%.3f,%.1f\n", label, (unsigned)bauds[b], (unsigned)size, ok, verified,
+			   (unsigned)fs.requests, seconds, ok ? size / 1024.0 / seconds : 0.0);
+	}
+
+	return 0;
+}
@@ -0,0 +1,112 @@
+/**
+ * Firmware upload benchmark for host builds: firmwareUpload() writes an image
+ * to a simulated bootloader behind VescSimPeer at several baud rates, and the
+ * effective rate in KB/s of simulated time is reported. The bootloader keeps
+ * what it receives and checks it against the image afterwards.
+ *
+ * The optional fault rate (per 1000 acks, dropped or corrupted) exercises the
+ * go-back-N recovery of the window.
+ */
+
+// g++ -std=gnu++11 -O2 -Isrc/host -Isrc example/firmwareBenchmark.cpp src/*.cpp -o firmwareBenchmark
+// ./firmwareBenchmark [label] [image KB] [faults per 1000]
+
+#include "VescSimPeer.h"
+
+#define FW_HEADER_SIZE 6
+
+struct bootloader_t
+{
+	uint8_t flash[1024 * 1024];
+	uint32_t erased;
+	uint32_t writes;
+};
+
+static bootloader_t boot;
+static LoopbackStream<1024 * 1024> image;
+static uint8_t reference[1024 * 1024];
+
+static bool serveBootloader(void *context, const uint8_t *payload, size_t len, uint8_t *reply, int32_t *index)
+{
+	bootloader_t *b = (bootloader_t *)context;
+	int32_t i = 1;
+
+	switch (payload[0])
+	{
+	case COMM_ERASE_NEW_APP:
+		b->erased = buffer_get_uint32(payload, &i);
+		memset(b->flash, 0xFF, sizeof(b->flash));
+		reply[(*index)++] = b->erased <= sizeof(b->flash);
+		return true;
+
+	case COMM_WRITE_NEW_APP_DATA:
+	{
+		uint32_t offset = buffer_get_uint32(payload, &i);
+		uint32_t n = len - i;
+		bool ok = offset + n <= b->erased;
+		if (ok)
+			memcpy(b->flash + offset, payload + i, n);
+		b->writes++;
+		reply[(*index)++] = ok;
+		buffer_append_uint32(reply, offset, index);
+		return true;
+	}
+
+	default:
+		return false;
+	}
+}
+
+int main(int argc, char **argv)
+{
+	const char *label = argc > 1 ? argv[1] : "current";
+	uint32_t size = (argc > 2 ? atoi(argv[2]) : 128) * 1024;
+	uint16_t rate = argc > 3 ? atoi(argv[3]) : 0;
+	static const uint32_t bauds[] = {115200, 230400, 460800, 921600, 2000000};
+
+	if (size == 0 || size + FW_HEADER_SIZE > sizeof(reference))
+		return 1;
+
+	for (uint32_t i = 0; i < size; i++)
+		reference[i] = (uint8_t)(i * 2654435761u >> 13);
+	uint16_t crc = crc16(reference, size);
+
+	VirtualClock::install(0, 1);
+
+	printf("label,baud,image_bytes,ok,verified,writes,seconds,kbytes_per_s\n");
+	for (size_t b = 0; b < sizeof(bauds) / sizeof(bauds[0]); b++)
+	{
+		VescSimPeer peer(bauds[b], 100);
+		peer.setHandler(serveBootloader, &boot);
+
+		VescSimPeer::faults_t faults = {};
+		faults.drop = rate / 2;
+		faults.corrupt = rate - rate / 2;
+		peer.setFaults(faults, 1 + b);
+
+		VescUart vesc(100);
+		vesc.setSerialPort(peer.port());
+
+		image.write(reference, size);
+		boot.writes = 0;
+
+		uint64_t start = vesc_host_clock().now_us();
+		bool ok = vesc.firmwareUpload(&image, size, crc);
+		double seconds = (vesc_host_clock().now_us() - start) / 1e6;
+
+		// Drop what is left of the image after a failed upload
+		uint8_t scratch[256];
+		while (image.available())
+			image.readBytes(scratch, sizeof(scratch));
+
+		int32_t index = 0;
+		bool verified = ok && buffer_get_uint32(boot.flash, &index) == size &&
+						buffer_get_uint16(boot.flash, &index) == crc &&
+						memcmp(boot.flash + FW_HEADER_SIZE, reference, size) == 0;
+
+		printf("%s,%u,%u,%d,%d,%u,%.3f,%.1f\n", label, (unsigned)bauds[b], (unsigned)size, ok, verified,
+			   (unsigned)boot.writes, seconds, ok ? size / 1024.0 / seconds : 0.0);
+	}
+
+	return 0;
+}
@@ -0,0 +1,158 @@
+/**
+ * Reactor scaling benchmark for host builds: N ports, each a pty pair with
+ * VescSimPeer on the master side, are served by one VescReactor and by a
+ * VescReactorPool. Every port has a soundUpdate() task due at all times, so
+ * the reactor runs flat out; the result is the replies per second over all
+ * ports for each port count.
+ *
+ * The peers answer without wire time or processing delay, from their own
+ * threads (one per 8 ports) waiting on epoll, so the numbers are the cost of
+ * the reactor, the library and the pty round trip.
+ *
+ *   label,mode,threads,ports,seconds,frames,frames_per_s,failures
+ */
+
+// g++ -std=gnu++11 -O2 -pthread -Isrc/host -Isrc example/reactorBenchmark.cpp src/*.cpp -o reactorBenchmark
+// ./reactorBenchmark [label] [seconds per run] [max ports] [pool threads]
+
+#include "VescReactor.h"
+#include "VescSimPeer.h"
+#include <memory>
+
+struct counter_t
+{
+	uint32_t ok;
+	uint32_t failed;
+};
+
+static void soundTask(VescUart &vesc, void *context)
+{
+	counter_t *c = (counter_t *)context;
+	if (vesc.soundUpdate())
+		c->ok++;
+	else
+		c->failed++;
+}
+
+/** Serves the master sides of a slice of the ports until stopped */
+static void servePeers(std::vector<VescSimPeer *> peers, std::vector<int> masters, const std::atomic<bool> *stop)
+{
+	int ep = epoll_create1(EPOLL_CLOEXEC);
+	std::vector<FdStream> sides(masters.size());
+	for (size_t i = 0; i < masters.size(); i++)
+	{
+		sides[i].setFd(masters[i]);
+		struct epoll_event ev;
+		memset(&ev, 0, sizeof(ev));
+		ev.events = EPOLLIN;
+		ev.data.u32 = i;
+		epoll_ctl(ep, EPOLL_CTL_ADD, masters[i], &ev);
+	}
+
+	struct epoll_event events[64];
+	while (!stop->load())
+	{
+		int n = epoll_wait(ep, events, 64, 10);
+		for (int i = 0; i < n; i++)
+			peers[events[i].data.u32]->serve(sides[events[i].data.u32]);
+	}
+	close(ep);
+}
+
+static void runPorts(const char *label, int ports, int threads, double seconds)
+{
+	std::vector<std::unique_ptr<LinuxSerial> > serials;
+	std::vector<std::unique_ptr<VescSimPeer> > peers;
+	std::vector<std::unique_ptr<VescUart> > uarts;
+	std::vector<int> masters;
+	std::vector<counter_t> counters(ports);
+
+	for (int i = 0; i < ports; i++)
+	{
+		serials.emplace_back(new LinuxSerial());
+		int master = serials.back()->openPty(921600);
+		if (master < 0)
+		{
+			fprintf(stderr, "no pty for port %d\n", i);
+			return;
+		}
+		masters.push_back(master);
+		peers.emplace_back(new VescSimPeer(0, 0));
+		peers.back()->sound.erpm = 1000 + i;
+		uarts.emplace_back(new VescUart(100));
+		counters[i].ok = 0;
+		counters[i].failed = 0;
+	}
+
+	std::atomic<bool> stop(false);
+	std::atomic<bool> serverStop(false);
+
+	std::vector<std::thread> servers;
+	for (int first = 0; first < ports; first += 8)
+	{
+		std::vector<VescSimPeer *> slice;
+		std::vector<int> fds;
+		for (int i = first; i < ports && i < first + 8; i++)
+		{
+			slice.push_back(peers[i].get());
+			fds.push_back(masters[i]);
+		}
+		servers.push_back(std::thread(servePeers, slice, fds, &serverStop));
+	}
+
+	VescReactor single;
+	VescReactorPool pool(threads);
+	for (int i = 0; i < ports; i++)
+	{
+		if (threads == 0)
+			single.schedule(single.add(uarts[i].get(), serials[i].get()), soundTask, &counters[i], 0);
+		else
+			pool.schedule(pool.add(uarts[i].get(), serials[i].get()), soundTask, &counters[i], 0);
+	}
+
+	std::thread timer([&stop, seconds] {
+		usleep((useconds_t)(seconds * 1e6));
+		stop = true;
+	});
+
+	uint64_t start = vesc_host_clock().now_us();
+	if (threads == 0)
+		single.run(&stop);
+	else
+		pool.run(&stop);
+	double elapsed = (vesc_host_clock().now_us() - start) / 1e6;
+
+	timer.join();
+	serverStop = true;
+	for (size_t i = 0; i < servers.size(); i++)
+		servers[i].join();
+	for (int i = 0; i < ports; i++)
+		close(masters[i]);
+
+	uint64_t frames = 0, failures = 0;
+	for (int i = 0; i < ports; i++)
+	{
+		frames += counters[i].ok;
+		failures += counters[i].failed;
+	}
+
+	printf("%s,%s,%d,%d,%.2f,%llu,%.0f,%llu\n", label, threads == 0 ? "reactor" : "pool", threads == 0 ? 1 : threads,
+		   ports, elapsed, (unsigned long long)frames, frames / elapsed, (unsigned long long)failures);
+	fflush(stdout);
+}
+
+int main(int argc, char **argv)
+{
+	const char *label = argc > 1 ? argv[1] : "current";
+	double seconds = argc > 2 ? atof(argv[2]) : 1.0;
+	int maxPorts = argc > 3 ? atoi(argv[3]) : 32;
+	int threads = argc > 4 ? atoi(argv[4]) : 4;
+
+	printf("label,mode,threads,ports,seconds,frames,frames_per_s,failures\n");
+	for (int ports = 1; ports <= maxPorts; ports *= 2)
+		runPorts(label, ports, 0, seconds);
+	for (int ports = 1; ports <= maxPorts; ports *= 2)
+		runPorts(label, ports, threads, seconds);
+
+	return 0;
+}
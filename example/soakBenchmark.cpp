@@ -0,0 +1,225 @@
+/**
+ * Soak benchmark for host builds: runs soundUpdate(), advancedUpdate() and
+ * get_sound_triggered() in turn against VescSimPeer for a stretch of
+ * simulated time, with faults injected into the replies, and reports per
+ * call
+ *
+ *   - sustained replies per second of simulated wire time
+ *   - latency percentiles in simulated us (wire time, processing delay), of
+ *     the successful calls and, separately, of the failed ones (timeouts)
+ *   - failures and recoveries (a success right after a failure)
+ *   - peak stack, measured on a painted stack of its own. The simulated peer
+ *     handles the requests on the main stack, every write switches back
+ *     there; its available() and readBytes() are a few bytes deep and stand
+ *     in for the UART driver. What an empty call uses is subtracted.
+ *
+ * One CSV line per call, tagged with a label so runs of two library versions
+ * can be put side by side. Build and run from the library directory:
+ */
+
+// g++ -std=gnu++11 -O2 -Isrc/host -Isrc example/soakBenchmark.cpp src/*.cpp -o soak
+// ./soak v1.0.1 [seconds] [baud] [faults per 1000] [seed]
+
+#include "VescSimPeer.h"
+#include <ucontext.h>
+#include <algorithm>
+#include <vector>
+
+struct callStats_t
+{
+	const char *name;
+	bool (*call)(void);
+	std::vector<uint32_t> latency;
+	std::vector<uint32_t> failedLatency;
+	uint32_t failures;
+	uint32_t recoveries;
+	bool failed;
+	size_t stack;
+};
+
+static VescUart UART(100);
+static VescSimPeer peer;
+
+static bool soundCall(void) { return UART.soundUpdate(); }
+static bool advancedCall(void) { return UART.advancedUpdate(); }
+static bool triggeredCall(void) { return UART.get_sound_triggered() == 1; }
+
+static bool emptyCall(void) { return true; }
+
+// Each call runs on this stack; bytes still holding the paint were never used
+static uint8_t callStack[64 * 1024];
+static ucontext_t mainContext;
+static ucontext_t callContext;
+static bool (*currentCall)(void);
+static bool currentOk;
+static bool inCall;
+
+/** A write the call hands to the main stack */
+struct pendingWrite_t
+{
+	const uint8_t *data;
+	size_t len;
+	size_t result;
+};
+
+static pendingWrite_t pending;
+
+/** The peer's port, but requests are handled on the main stack while a call is measured */
+class OutsideStream : public Stream
+{
+public:
+	int available(void) override { return peer.port()->available(); }
+	int read(void) override { return peer.port()->read(); }
+	int peek(void) override { return peer.port()->peek(); }
+	size_t readBytes(uint8_t *buffer, size_t length) override { return peer.port()->readBytes(buffer, length); }
+	size_t write(uint8_t c) override { return write(&c, 1); }
+	size_t write(const uint8_t *buffer, size_t size) override
+	{
+		if (!inCall)
+			return peer.port()->write(buffer, size);
+		pending.data = buffer;
+		pending.len = size;
+		swapcontext(&callContext, &mainContext);
+		return pending.result;
+	}
+
+	using Stream::readBytes;
+	using Print::write;
+};
+
+static OutsideStream outsidePort;
+
+static void trampoline(void)
+{
+	currentOk = currentCall();
+	inCall = false;
+}
+
+/** Run call on the painted stack, @return the bytes of it that were used */
+static size_t stackCall(bool (*call)(void))
+{
+	memset(callStack, 0xA5, sizeof(callStack));
+
+	getcontext(&callContext);
+	callContext.uc_stack.ss_sp = callStack;
+	callContext.uc_stack.ss_size = sizeof(callStack);
+	callContext.uc_link = &mainContext;
+	makecontext(&callContext, trampoline, 0);
+
+	currentCall = call;
+	inCall = true;
+	swapcontext(&mainContext, &callContext);
+	while (inCall)
+	{
+		pending.result = peer.port()->write(pending.data, pending.len);
+		swapcontext(&mainContext, &callContext);
+	}
+
+	size_t untouched = 0;
+	while (untouched < sizeof(callStack) && callStack[untouched] == 0xA5)
+		untouched++;
+	return sizeof(callStack) - untouched;
+}
+
+static size_t baseline;
+
+static bool measuredCall(callStats_t *stats)
+{
+	uint64_t start = vesc_host_clock().now_us();
+	size_t used = stackCall(stats->call);
+	uint32_t latency = (uint32_t)(vesc_host_clock().now_us() - start);
+
+	stats->stack = std::max(stats->stack, used - baseline);
+
+	if (currentOk)
+	{
+		stats->latency.push_back(latency);
+		if (stats->failed)
+			stats->recoveries++;
+	}
+	else
+	{
+		stats->failedLatency.push_back(latency);
+		stats->failures++;
+	}
+	stats->failed = !currentOk;
+	return currentOk;
+}
+
+static uint32_t percentile(std::vector<uint32_t> &values, int p)
+{
+	if (values.empty())
+		return 0;
+	size_t i = (values.size() - 1) * p / 100;
+	std::nth_element(values.begin(), values.begin() + i, values.end());
+	return values[i];
+}
+
+int main(int argc, char **argv)
+{
+	const char *label = argc > 1 ? argv[1] : "current";
+	uint32_t seconds = argc > 2 ? atoi(argv[2]) : 60;
+	uint32_t baud = argc > 3 ? atoi(argv[3]) : 115200;
+	uint16_t rate = argc > 4 ? atoi(argv[4]) : 10;
+	uint32_t seed = argc > 5 ? atoi(argv[5]) : 1;
+
+	VirtualClock::install(0, 1);
+
+	peer.setBaud(baud);
+	peer.sound.erpm = 3200;
+	peer.sound.inputVoltage = 50.4;
+	peer.advanced.engine_sound_volume = 80;
+	peer.soundTriggered = 1;
+
+	VescSimPeer::faults_t faults = {};
+	faults.drop = rate;
+	faults.corrupt = rate;
+	faults.duplicate = rate;
+	faults.delay = rate;
+	faults.split = rate;
+	faults.delay_us = 5000;
+	faults.split_gap_us = 2000;
+	peer.setFaults(faults, seed);
+
+	UART.setSerialPort(&outsidePort);
+	UART.get_vesc_ready();
+	baseline = stackCall(emptyCall);
+
+	callStats_t calls[] = {
+		{"soundUpdate", soundCall, {}, {}, 0, 0, false, 0},
+		{"advancedUpdate", advancedCall, {}, {}, 0, 0, false, 0},
+		{"get_sound_triggered", triggeredCall, {}, {}, 0, 0, false, 0},
+	};
+	const int count = sizeof(calls) / sizeof(calls[0]);
+
+	uint64_t start = vesc_host_clock().now_us();
+	uint64_t end = start + (uint64_t)seconds * 1000000;
+	uint64_t wallStart = vesc_host_steady_us();
+
+	for (int i = 0; vesc_host_clock().now_us() < end; i = (i + 1) % count)
+		measuredCall(&calls[i]);
+
+	double simSeconds = (vesc_host_clock().now_us() - start) / 1e6;
+	double wallSeconds = (vesc_host_steady_us() - wallStart) / 1e6;
+
+	printf("label,call,ok,failed,recovered,replies_per_s,p50_us,p90_us,p99_us,max_us,failed_p50_us,failed_max_us,"
+		   "stack_bytes\n");
+	uint32_t total = 0;
+	for (int i = 0; i < count; i++)
+	{
+		callStats_t &c = calls[i];
+		size_t ok = c.latency.size();
+		total += ok;
+		printf("%s,%s,%u,%u,%u,%.1f,%u,%u,%u,%u,%u,%u,%u\n", label, c.name, (unsigned)ok, c.failures, c.recoveries,
+			   ok / simSeconds, percentile(c.latency, 50), percentile(c.latency, 90), percentile(c.latency, 99),
+			   percentile(c.latency, 100), percentile(c.failedLatency, 50), percentile(c.failedLatency, 100),
+			   (unsigned)c.stack);
+	}
+
+	const VescSimPeer::stats_t &s = peer.get_stats();
+	printf("%s,total,%u,,,%.1f,,,,,,,\n", label, total, total / simSeconds);
+	fprintf(stderr, "%.0f s simulated in %.2f s, peer: %u requests %u replies, injected %u dropped %u corrupted "
+			"%u duplicated %u delayed %u split\n", simSeconds, wallSeconds, s.requests, s.replies, s.dropped,
+			s.corrupted, s.duplicated, s.delayed, s.split);
+	return 0;
+}
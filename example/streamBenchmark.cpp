@@ -0,0 +1,158 @@
+/**
+ * Byte path benchmark for host builds: how much the virtual Stream interface
+ * costs on the receive side, measured three ways
+ *
+ *   - a plain byte loop: available() and read() per byte through Stream *
+ *     (virtual) and through a final class the compiler inlines, and block
+ *     readBytes() through Stream *
+ *   - whole soundUpdate() requests on a stream with block reads, and on one
+ *     that only has the per-byte read(), as before the block reads
+ *
+ * Both streams play one recorded 20 byte float package reply over and over,
+ * once per request in the soundUpdate() cases.
+ *
+ *   label,case,bytes,ns_per_byte
+ */
+
+// g++ -std=gnu++11 -O2 -Isrc/host -Isrc example/streamBenchmark.cpp src/*.cpp -o streamBenchmark
+// ./streamBenchmark [label] [frames]
+
+#include "VescHost.h"
+#include "VescUart.h"
+#include <algorithm>
+
+/** RepeatStream whose calls are bound at compile time when the type is known */
+class InlineStream final : public RepeatStream
+{
+};
+
+/** RepeatStream without the block read, Stream::readBytes() calls read() per byte */
+class ByteStream : public Stream
+{
+public:
+	RepeatStream source;
+
+	int available(void) override { return source.available(); }
+	int read(void) override { return source.read(); }
+	int peek(void) override { return source.peek(); }
+	size_t write(uint8_t c) override { return source.write(c); }
+	size_t write(const uint8_t *data, size_t size) override { return source.write(data, size); }
+
+	using Stream::readBytes;
+	using Print::write;
+};
+
+static volatile uint32_t sink;
+
+/** Per byte through whatever S binds to: Stream is virtual, InlineStream is not */
+template <typename S>
+static uint32_t byteLoop(S &stream, uint64_t bytes)
+{
+	uint32_t sum = 0;
+	for (uint64_t i = 0; i < bytes; i++)
+	{
+		if (stream.available() > 0)
+			sum += stream.read();
+	}
+	return sum;
+}
+
+static uint32_t blockLoop(Stream &stream, uint64_t bytes)
+{
+	uint8_t block[64];
+	uint32_t sum = 0;
+	for (uint64_t i = 0; i < bytes;)
+	{
+		int n = stream.available();
+		size_t got = stream.readBytes(block, n < (int)sizeof(block) ? n : sizeof(block));
+		sum += block[0];
+		i += got;
+	}
+	return sum;
+}
+
+static uint32_t frameLoop(VescUart &vesc, uint64_t frames)
+{
+	uint32_t sum = 0;
+	for (uint64_t i = 0; i < frames; i++)
+		sum += vesc.soundUpdate();
+	return sum;
+}
+
+static double nsPerByte(uint64_t start, uint64_t bytes)
+{
+	return (vesc_host_clock().now_us() - start) * 1000.0 / bytes;
+}
+
+int main(int argc, char **argv)
+{
+	const char *label = argc > 1 ? argv[1] : "current";
+	uint64_t frames = argc > 2 ? atoi(argv[2]) : 2000000;
+
+	// COMM_CUSTOM_APP_DATA sound info reply, 20 bytes of payload
+	uint8_t payload[20] = {COMM_CUSTOM_APP_DATA, ESP32_COMMAND_ID, ESP_COMMAND_ENGINE_SOUND_INFO};
+	for (uint8_t i = 3; i < sizeof(payload); i++)
+		payload[i] = i * 13;
+	uint16_t crc = crc16(payload, sizeof(payload));
+
+	uint8_t frame[32];
+	size_t len = 0;
+	frame[len++] = 2;
+	frame[len++] = sizeof(payload);
+	memcpy(frame + len, payload, sizeof(payload));
+	len += sizeof(payload);
+	frame[len++] = (uint8_t)(crc >> 8);
+	frame[len++] = (uint8_t)(crc & 0xFF);
+	frame[len++] = 3;
+
+	InlineStream inlined;
+	ByteStream bytewise;
+	inlined.setFrame(frame, len);
+	bytewise.source.setFrame(frame, len, true);
+	// Read back through volatile, so the compiler cannot tell what it points to
+	// and has to make the virtual calls, as with a UART driver in another unit
+	Stream *volatile virtualStream = &inlined;
+
+	uint64_t bytes = frames * len;
+	double best[5] = {1e9, 1e9, 1e9, 1e9, 1e9};
+
+	VescUart blockUart(100);
+	VescUart byteUart(100);
+	blockUart.setSerialPort(&inlined);
+	byteUart.setSerialPort(&bytewise);
+
+	// Best of five alternating rounds, the rest is scheduling noise
+	for (int round = 0; round < 5; round++)
+	{
+		uint64_t start = vesc_host_clock().now_us();
+		sink += byteLoop(*virtualStream, bytes / 5);
+		best[0] = std::min(best[0], nsPerByte(start, bytes / 5));
+
+		start = vesc_host_clock().now_us();
+		sink += byteLoop(inlined, bytes / 5);
+		best[1] = std::min(best[1], nsPerByte(start, bytes / 5));
+
+		start = vesc_host_clock().now_us();
+		sink += blockLoop(*virtualStream, bytes / 5);
+		best[2] = std::min(best[2], nsPerByte(start, bytes / 5));
+
+		// Requests get one reply each, the byte loops above read on and on
+		inlined.setFrame(frame, len, true);
+		start = vesc_host_clock().now_us();
+		sink += frameLoop(blockUart, frames / 5);
+		best[3] = std::min(best[3], nsPerByte(start, frames / 5 * len));
+
+		start = vesc_host_clock().now_us();
+		sink += frameLoop(byteUart, frames / 5);
+		best[4] = std::min(best[4], nsPerByte(start, frames / 5 * len));
+		inlined.setFrame(frame, len);
+	}
+
+	static const char *names[] = {"byte_virtual", "byte_inlined", "block_virtual", "frame_block_reads", "frame_byte_reads"};
+
+	printf("label,case,bytes,ns_per_byte\n");
+	for (int i = 0; i < 5; i++)
+		printf("%s,%s,%llu,%.2f\n", label, names[i], (unsigned long long)bytes, best[i]);
+
+	return 0;
+}
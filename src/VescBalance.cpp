@@ -0,0 +1,135 @@
+#include <stdint.h>
+#include "VescUart.h"
+
+/**
+ * COMM_GET_DECODED_BALANCE -> pid_output, pitch, roll (float32 1e6), diff_time
+ *                             (uint32), motor_current, debug1 (float32 1e6),
+ *                             state, switch_state (uint16), adc1, adc2, debug2
+ *                             (float32 1e6)
+ *
+ * balanceData is published with a sequence counter: it is odd while the struct
+ * is written, a reader that saw it odd or changed copies again.
+ */
+
+#define BALANCE_REPLY_LEN 41
+
+void VescUart::balanceRequest(uint8_t canId)
+{
+	int32_t index = 0;
+	uint8_t payload[3];
+
+	if (canId != 0)
+	{
+		payload[index++] = {COMM_FORWARD_CAN};
+		payload[index++] = canId;
+	}
+	payload[index++] = {COMM_GET_DECODED_BALANCE};
+	packSendPayload(payload, index);
+}
+
+bool VescUart::balanceDecode(uint8_t *message, int lenPay)
+{
+	if (lenPay < BALANCE_REPLY_LEN || message[0] != COMM_GET_DECODED_BALANCE)
+		return false;
+
+	balanceData_t staged;
+	int32_t index = 1;
+	staged.pid_output = buffer_get_float32(message, 1e6, &index);
+	staged.pitch_angle = buffer_get_float32(message, 1e6, &index);
+	staged.roll_angle = buffer_get_float32(message, 1e6, &index);
+	staged.diff_time = buffer_get_uint32(message, &index);
+	staged.motor_current = buffer_get_float32(message, 1e6, &index);
+	staged.debug1 = buffer_get_float32(message, 1e6, &index);
+	staged.state = buffer_get_uint16(message, &index);
+	staged.switch_state = buffer_get_uint16(message, &index);
+	staged.adc1 = buffer_get_float32(message, 1e6, &index);
+	staged.adc2 = buffer_get_float32(message, 1e6, &index);
+	staged.debug2 = buffer_get_float32(message, 1e6, &index);
+
+	balanceSeq++;
+	__sync_synchronize();
+	balanceData = staged;
+	__sync_synchronize();
+	balanceSeq++;
+
+	if (debugPort != NULL)
+		debugPort->printf("Balance pitch %.2f state %d\n", staged.pitch_angle, staged.state);
+
+	return true;
+}
+
+bool VescUart::balanceUpdate(uint8_t canId)
+{
+	balanceRequest(canId);
+
+	uint8_t message[256];
+	int messageLength = receiveUartMessage(message);
+
+	if (!balanceDecode(message, messageLength))
+		return false;
+
+	balanceSkip = 0;
+	return true;
+}
+
+bool VescUart::balanceSoundUpdate(uint8_t canId)
+{
+	dropStale();
+
+	bool askBalance = balanceSkip == 0;
+	if (askBalance)
+		balanceRequest(canId);
+	else
+		balanceSkip--;
+
+	esp_commands command = soundFormat != 0 ? ESP_COMMAND_ENGINE_SOUND_COMPACT : ESP_COMMAND_ENGINE_SOUND_INFO;
+	espSend(command, canId);
+
+	// The replies come back in order: once the sound reply is here, a balance
+	// reply that did not come first is not coming
+	bool balance = false;
+	bool sound = false;
+
+	for (uint8_t i = 0; i < 2 && !sound; i++)
+	{
+		uint8_t message[256];
+		int messageLength = receiveUartMessage(message);
+
+		if (messageLength <= 0)
+			break;
+
+		if (message[0] == COMM_GET_DECODED_BALANCE)
+			balance = balanceDecode(message, messageLength);
+		else
+			sound = espDecode(command, message, messageLength);
+	}
+
+	if (command == ESP_COMMAND_ENGINE_SOUND_COMPACT)
+		soundCompactResult(sound);
+
+	// Not a balance app, or none running: stop asking for a while
+	if (askBalance && sound && !balance)
+	{
+		if (debugPort != NULL)
+			debugPort->println("No balance reply");
+		balanceSkip = VESC_BALANCE_RETRY;
+	}
+
+	return balance && sound;
+}
+
+VescUart::balanceData_t VescUart::get_balance_data(void)
+{
+	balanceData_t copy;
+	uint32_t seq;
+
+	do
+	{
+		seq = balanceSeq;
+		__sync_synchronize();
+		copy = balanceData;
+		__sync_synchronize();
+	} while ((seq & 1) || seq != balanceSeq);
+
+	return copy;
+}
@@ -0,0 +1,291 @@
+#include <stdint.h>
+#include "VescUart.h"
+
+/**
+ * COMM_BMS_GET_VALUES is decoded while it is received. The reply can be longer
+ * than 256 bytes (32 cells and 50 sensors), so it is never buffered: every field
+ * is collected in a 4 byte scratch area and dispatched by bmsField(). The
+ * summary and the selected cells and sensors are staged in the decoder and
+ * only published when the CRC matched.
+ *
+ * Reply layout (bms.c):
+ *   id, v_tot, v_charge, i_in, i_in_ic (float32 1e6), ah_cnt, wh_cnt (float32 1e3),
+ *   cell_num, v_cell[] (float16 1e3), bal_state[], temp_adc_num, temps_adc[] (float16 1e2),
+ *   temp_ic, temp_hum, hum, temp_max_cell (float16 1e2), soc, soh (float16 1e3), can_id,
+ *   ah_cnt_chg_total, wh_cnt_chg_total, ah_cnt_dis_total, wh_cnt_dis_total (float32_auto)
+ */
+enum
+{
+	BMS_STEP_ID = 0,
+	BMS_STEP_V_TOT,
+	BMS_STEP_V_CHARGE,
+	BMS_STEP_I_IN,
+	BMS_STEP_I_IN_IC,
+	BMS_STEP_AH_CNT,
+	BMS_STEP_WH_CNT,
+	BMS_STEP_CELL_NUM,
+	BMS_STEP_V_CELL,
+	BMS_STEP_BAL_STATE,
+	BMS_STEP_TEMP_NUM,
+	BMS_STEP_TEMPS,
+	BMS_STEP_TEMP_IC,
+	BMS_STEP_TEMP_HUM,
+	BMS_STEP_HUM,
+	BMS_STEP_TEMP_MAX_CELL,
+	BMS_STEP_SOC,
+	BMS_STEP_SOH,
+	BMS_STEP_CAN_ID,
+	BMS_STEP_AH_CHG_TOTAL,
+	BMS_STEP_WH_CHG_TOTAL,
+	BMS_STEP_AH_DIS_TOTAL,
+	BMS_STEP_WH_DIS_TOTAL,
+	BMS_STEP_DONE,
+};
+
+static uint8_t bms_step_size(uint8_t step)
+{
+	switch (step)
+	{
+	case BMS_STEP_ID:
+	case BMS_STEP_CELL_NUM:
+	case BMS_STEP_BAL_STATE:
+	case BMS_STEP_TEMP_NUM:
+	case BMS_STEP_CAN_ID:
+		return 1;
+
+	case BMS_STEP_V_TOT:
+	case BMS_STEP_V_CHARGE:
+	case BMS_STEP_I_IN:
+	case BMS_STEP_I_IN_IC:
+	case BMS_STEP_AH_CNT:
+	case BMS_STEP_WH_CNT:
+	case BMS_STEP_AH_CHG_TOTAL:
+	case BMS_STEP_WH_CHG_TOTAL:
+	case BMS_STEP_AH_DIS_TOTAL:
+	case BMS_STEP_WH_DIS_TOTAL:
+		return 4;
+
+	default:
+		return 2;
+	}
+}
+
+// Index i falls into the caller's range first..first+count and the staging area
+static bool bms_selected(uint8_t i, uint8_t first, uint8_t count, uint8_t staging)
+{
+	return i >= first && i - first < count && i - first < staging;
+}
+
+// Number of staged entries of a range when total were received
+static uint8_t bms_received(uint8_t total, uint8_t first, uint8_t count, uint8_t staging)
+{
+	if (total <= first)
+		return 0;
+	uint8_t n = total - first;
+	if (n > count)
+		n = count;
+	return n < staging ? n : staging;
+}
+
+void VescUart::bmsSink(void *context, const uint8_t *data, uint16_t len)
+{
+	bmsDecoder_t *dec = (bmsDecoder_t *)context;
+
+	for (uint16_t i = 0; i < len && dec->valid && dec->step != BMS_STEP_DONE; i++)
+	{
+		dec->field[dec->have++] = data[i];
+
+		if (dec->have == bms_step_size(dec->step))
+		{
+			dec->owner->bmsField(dec);
+			dec->have = 0;
+		}
+	}
+}
+
+void VescUart::bmsField(bmsDecoder_t *dec)
+{
+	bmsData_t *d = &dec->staged;
+	int32_t index = 0;
+	uint8_t next = dec->step + 1;
+
+	switch (dec->step)
+	{
+	case BMS_STEP_ID:
+		dec->valid = (dec->field[0] == COMM_BMS_GET_VALUES);
+		break;
+
+	case BMS_STEP_V_TOT:		d->v_tot = buffer_get_float32(dec->field, 1e6, &index); break;
+	case BMS_STEP_V_CHARGE:		d->v_charge = buffer_get_float32(dec->field, 1e6, &index); break;
+	case BMS_STEP_I_IN:			d->i_in = buffer_get_float32(dec->field, 1e6, &index); break;
+	case BMS_STEP_I_IN_IC:		d->i_in_ic = buffer_get_float32(dec->field, 1e6, &index); break;
+	case BMS_STEP_AH_CNT:		d->ah_cnt = buffer_get_float32(dec->field, 1e3, &index); break;
+	case BMS_STEP_WH_CNT:		d->wh_cnt = buffer_get_float32(dec->field, 1e3, &index); break;
+
+	case BMS_STEP_CELL_NUM:
+		d->cell_num = dec->field[0];
+		dec->item = 0;
+		if (d->cell_num == 0)
+			next = BMS_STEP_TEMP_NUM;
+		break;
+
+	case BMS_STEP_V_CELL:
+	{
+		int16_t raw = buffer_get_int16(dec->field, &index);
+		float v = (float)raw / 1e3;
+		uint8_t i = dec->item++;
+
+		if (i == 0 || v < d->v_cell_min)
+			d->v_cell_min = v;
+		if (i == 0 || v > d->v_cell_max)
+			d->v_cell_max = v;
+		dec->cellSum += v;
+
+		if (bms_selected(i, bmsStorage.cellFirst, bmsStorage.cellCount, sizeof(dec->cells) / sizeof(dec->cells[0])))
+			dec->cells[i - bmsStorage.cellFirst] = raw;
+
+		if (dec->item < d->cell_num)
+			next = dec->step;
+		else
+			dec->item = 0;
+		break;
+	}
+
+	case BMS_STEP_BAL_STATE:
+	{
+		uint8_t i = dec->item++;
+
+		if (bms_selected(i, bmsStorage.cellFirst, bmsStorage.cellCount, sizeof(dec->balance)))
+			dec->balance[i - bmsStorage.cellFirst] = dec->field[0];
+
+		if (dec->item < d->cell_num)
+			next = dec->step;
+		break;
+	}
+
+	case BMS_STEP_TEMP_NUM:
+		d->temp_adc_num = dec->field[0];
+		dec->item = 0;
+		if (d->temp_adc_num == 0)
+			next = BMS_STEP_TEMP_IC;
+		break;
+
+	case BMS_STEP_TEMPS:
+	{
+		int16_t raw = buffer_get_int16(dec->field, &index);
+		float t = (float)raw / 1e2;
+		uint8_t i = dec->item++;
+
+		if (i == 0 || t < d->temp_adc_min)
+			d->temp_adc_min = t;
+		if (i == 0 || t > d->temp_adc_max)
+			d->temp_adc_max = t;
+		dec->tempSum += t;
+
+		if (bms_selected(i, bmsStorage.tempFirst, bmsStorage.tempCount, sizeof(dec->temps) / sizeof(dec->temps[0])))
+			dec->temps[i - bmsStorage.tempFirst] = raw;
+
+		if (dec->item < d->temp_adc_num)
+			next = dec->step;
+		break;
+	}
+
+	case BMS_STEP_TEMP_IC:		d->temp_ic = buffer_get_float16(dec->field, 1e2, &index); break;
+	case BMS_STEP_TEMP_HUM:		d->temp_hum = buffer_get_float16(dec->field, 1e2, &index); break;
+	case BMS_STEP_HUM:			d->hum = buffer_get_float16(dec->field, 1e2, &index); break;
+	case BMS_STEP_TEMP_MAX_CELL:	d->temp_max_cell = buffer_get_float16(dec->field, 1e2, &index); break;
+	case BMS_STEP_SOC:			d->soc = buffer_get_float16(dec->field, 1e3, &index); break;
+	case BMS_STEP_SOH:			d->soh = buffer_get_float16(dec->field, 1e3, &index); break;
+	case BMS_STEP_CAN_ID:		d->can_id = dec->field[0]; break;
+	case BMS_STEP_AH_CHG_TOTAL:	d->ah_cnt_chg_total = buffer_get_float32_auto(dec->field, &index); break;
+	case BMS_STEP_WH_CHG_TOTAL:	d->wh_cnt_chg_total = buffer_get_float32_auto(dec->field, &index); break;
+	case BMS_STEP_AH_DIS_TOTAL:	d->ah_cnt_dis_total = buffer_get_float32_auto(dec->field, &index); break;
+	case BMS_STEP_WH_DIS_TOTAL:	d->wh_cnt_dis_total = buffer_get_float32_auto(dec->field, &index); break;
+	}
+
+	dec->step = next;
+}
+
+bool VescUart::bmsUpdate(uint8_t canId)
+{
+	if (debugPort != NULL)
+		debugPort->println("bmsUpdate();");
+
+	int32_t index = 0;
+	uint8_t payload[3];
+
+	if (canId != 0)
+	{
+		payload[index++] = {COMM_FORWARD_CAN};
+		payload[index++] = canId;
+	}
+	payload[index++] = {COMM_BMS_GET_VALUES};
+	packSendPayload(payload, index);
+
+	bmsDecoder_t dec = {};
+	dec.owner = this;
+	dec.valid = true;
+
+	int messageLength = receiveUartStream(COMM_BMS_GET_VALUES, bmsSink, &dec);
+	if (debugPort != NULL)
+		debugPort->printf("message Length :%d\r\n", messageLength);
+
+	// Firmware before the charge/discharge counters were added stops after
+	// soh/can_id, everything up to the temperatures is required.
+	if (messageLength <= 0 || !dec.valid || dec.step <= BMS_STEP_TEMPS)
+		return false;
+
+	if (dec.staged.cell_num > 0)
+	{
+		dec.staged.v_cell_avg = dec.cellSum / dec.staged.cell_num;
+		dec.staged.v_cell_imbalance = dec.staged.v_cell_max - dec.staged.v_cell_min;
+	}
+	if (dec.staged.temp_adc_num > 0)
+		dec.staged.temp_adc_avg = dec.tempSum / dec.staged.temp_adc_num;
+
+	bmsData = dec.staged;
+
+	// CRC is good, hand the selected arrays over
+	uint8_t cells = bms_received(bmsData.cell_num, bmsStorage.cellFirst, bmsStorage.cellCount, sizeof(dec.balance));
+	for (uint8_t i = 0; i < cells; i++)
+	{
+		if (bmsStorage.v_cell != NULL)
+			bmsStorage.v_cell[i] = (float)dec.cells[i] / 1e3;
+		if (bmsStorage.bal_state != NULL)
+			bmsStorage.bal_state[i] = dec.balance[i];
+	}
+
+	uint8_t temps = bms_received(bmsData.temp_adc_num, bmsStorage.tempFirst, bmsStorage.tempCount,
+								 sizeof(dec.temps) / sizeof(dec.temps[0]));
+	for (uint8_t i = 0; i < temps && bmsStorage.temps != NULL; i++)
+		bmsStorage.temps[i] = (float)dec.temps[i] / 1e2;
+
+	if (debugPort != NULL)
+	{
+		debugPort->printf(" V total		:%.2f\n", bmsData.v_tot);
+		debugPort->printf(" Cells		:%d min %.3f max %.3f\n", bmsData.cell_num, bmsData.v_cell_min, bmsData.v_cell_max);
+		debugPort->printf(" SOC			:%.2f\n", bmsData.soc);
+	}
+
+	return true;
+}
+
+void VescUart::setBmsCellStorage(float *v_cell, bool *bal_state, uint8_t first, uint8_t count)
+{
+	bmsStorage.v_cell = v_cell;
+	bmsStorage.bal_state = bal_state;
+	bmsStorage.cellFirst = first;
+	bmsStorage.cellCount = count;
+}
+
+void VescUart::setBmsTempStorage(float *temps, uint8_t first, uint8_t count)
+{
+	bmsStorage.temps = temps;
+	bmsStorage.tempFirst = first;
+	bmsStorage.tempCount = count;
+}
+
+const VescUart::bmsData_t &VescUart::get_bms_data(void)
+{
+	return bmsData;
+}
@@ -0,0 +1,64 @@
+#include <stdint.h>
+#include "VescUart.h"
+
+/**
+ * Raw UART capture, see VescReplay.h for the log format. Every chunk goes to
+ * the log as it passes through uartRead() / uartWrite(), so the log holds the
+ * bytes exactly as they were on the wire, broken frames included.
+ */
+
+static uint8_t capture_varint(uint8_t *buffer, uint32_t value)
+{
+	uint8_t len = 0;
+	while (value >= 0x80)
+	{
+		buffer[len++] = (uint8_t)(value | 0x80);
+		value >>= 7;
+	}
+	buffer[len++] = (uint8_t)value;
+	return len;
+}
+
+void VescUart::setCapture(Print *log)
+{
+	captureLog = log;
+	if (log == NULL)
+		return;
+
+	captureLast = micros();
+
+	uint8_t header[VESC_CAPTURE_HEADER] = {'V', 'C', 'A', 'P', VESC_CAPTURE_VERSION};
+	int32_t index = 5;
+	buffer_append_uint32(header, captureLast, &index);
+	log->write(header, sizeof(header));
+}
+
+void VescUart::captureChunk(uint8_t direction, const uint8_t *data, size_t len)
+{
+	uint32_t now = micros();
+	uint8_t record[11];
+	uint8_t count = 0;
+
+	record[count++] = direction;
+	count += capture_varint(record + count, now - captureLast);
+	count += capture_varint(record + count, len);
+	captureLast = now;
+
+	captureLog->write(record, count);
+	captureLog->write(data, len);
+}
+
+size_t VescUart::uartRead(uint8_t *buffer, size_t len)
+{
+	size_t n = serialPort->readBytes(buffer, len);
+	if (captureLog != NULL && n > 0)
+		captureChunk(VESC_CAPTURE_RX, buffer, n);
+	return n;
+}
+
+void VescUart::uartWrite(const uint8_t *buffer, size_t len)
+{
+	serialPort->write(buffer, len);
+	if (captureLog != NULL)
+		captureChunk(VESC_CAPTURE_TX, buffer, len);
+}
@@ -0,0 +1,119 @@
+#ifndef VESCCODEC_H_
+#define VESCCODEC_H_
+
+#include <stdint.h>
+#include "buffer.h"
+
+/*
+ * Compile-time field layouts for fixed-size frames. A layout lists the fields
+ * of a struct in wire order with their encoding; pack() and unpack() are
+ * generated from it. unpack() checks the frame length once against the
+ * constexpr size, the fields are then decoded without further checks.
+ *
+ *   typedef codec_layout<
+ *       codec_field<data_t, float, &data_t::erpm, CODEC_FLOAT32_AUTO>,
+ *       codec_field<data_t, float, &data_t::volts, CODEC_FLOAT16, 100> > layout;
+ *
+ * Scales are integers, template arguments cannot be floats.
+ */
+
+typedef enum
+{
+	CODEC_UINT8 = 0,
+	CODEC_UINT16,
+	CODEC_INT16,
+	CODEC_UINT32,
+	CODEC_INT32,
+	CODEC_FLOAT16,		// int16 / scale
+	CODEC_FLOAT32,		// int32 / scale
+	CODEC_FLOAT32_AUTO,
+} codec_wire;
+
+constexpr int codec_wire_size(codec_wire wire)
+{
+	return wire == CODEC_UINT8 ? 1 :
+		   (wire == CODEC_UINT16 || wire == CODEC_INT16 || wire == CODEC_FLOAT16) ? 2 : 4;
+}
+
+template <typename S, typename T, T S::*Member, codec_wire Wire, int Scale = 1>
+struct codec_field
+{
+	typedef S record;
+	static constexpr int size = codec_wire_size(Wire);
+
+	static void unpack(S &s, const uint8_t *buffer, int32_t *index)
+	{
+		switch (Wire)
+		{
+		case CODEC_UINT8:			s.*Member = (T)buffer[(*index)++]; break;
+		case CODEC_UINT16:			s.*Member = (T)buffer_get_uint16(buffer, index); break;
+		case CODEC_INT16:			s.*Member = (T)buffer_get_int16(buffer, index); break;
+		case CODEC_UINT32:			s.*Member = (T)buffer_get_uint32(buffer, index); break;
+		case CODEC_INT32:			s.*Member = (T)buffer_get_int32(buffer, index); break;
+		case CODEC_FLOAT16:			s.*Member = (T)buffer_get_float16(buffer, Scale, index); break;
+		case CODEC_FLOAT32:			s.*Member = (T)buffer_get_float32(buffer, Scale, index); break;
+		case CODEC_FLOAT32_AUTO:	s.*Member = (T)buffer_get_float32_auto(buffer, index); break;
+		}
+	}
+
+	static void pack(const S &s, uint8_t *buffer, int32_t *index)
+	{
+		switch (Wire)
+		{
+		case CODEC_UINT8:			buffer[(*index)++] = (uint8_t)(s.*Member); break;
+		case CODEC_UINT16:			buffer_append_uint16(buffer, (uint16_t)(s.*Member), index); break;
+		case CODEC_INT16:			buffer_append_int16(buffer, (int16_t)(s.*Member), index); break;
+		case CODEC_UINT32:			buffer_append_uint32(buffer, (uint32_t)(s.*Member), index); break;
+		case CODEC_INT32:			buffer_append_int32(buffer, (int32_t)(s.*Member), index); break;
+		case CODEC_FLOAT16:			buffer_append_float16(buffer, s.*Member, Scale, index); break;
+		case CODEC_FLOAT32:			buffer_append_float32(buffer, s.*Member, Scale, index); break;
+		case CODEC_FLOAT32_AUTO:	buffer_append_float32_auto(buffer, s.*Member, index); break;
+		}
+	}
+};
+
+template <typename... Fields>
+struct codec_sum;
+
+template <>
+struct codec_sum<>
+{
+	static constexpr int size = 0;
+};
+
+template <typename F, typename... Rest>
+struct codec_sum<F, Rest...>
+{
+	static constexpr int size = F::size + codec_sum<Rest...>::size;
+};
+
+template <typename F, typename... Rest>
+struct codec_layout
+{
+	typedef typename F::record record;
+	static constexpr int size = codec_sum<F, Rest...>::size;
+
+	/**
+	 * Decode the fields starting at *index. len is the length of buffer; nothing
+	 * is written to s when the frame is too short.
+	 */
+	static bool unpack(record &s, const uint8_t *buffer, int32_t len, int32_t *index)
+	{
+		if (len - *index < size)
+			return false;
+
+		// Braced lists are evaluated in order, one call per field
+		int order[] = {(F::unpack(s, buffer, index), 0), (Rest::unpack(s, buffer, index), 0)...};
+		(void)order;
+		return true;
+	}
+
+	/** Encode the fields at *index, buffer must have size bytes free */
+	static void pack(const record &s, uint8_t *buffer, int32_t *index)
+	{
+		int order[] = {(F::pack(s, buffer, index), 0), (Rest::pack(s, buffer, index), 0)...};
+		(void)order;
+	}
+};
+
+#endif /* VESCCODEC_H_ */
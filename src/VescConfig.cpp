@@ -0,0 +1,170 @@
+#include <stdint.h>
+#include "VescUart.h"
+
+/**
+ * COMM_GET_MCCONF / COMM_GET_APPCONF replies are several hundred bytes. They are
+ * decoded while they are received: only the bytes of the requested fields are
+ * kept (4 bytes per field) and they are converted into the caller's variables
+ * once the CRC of the whole frame has been verified.
+ */
+
+uint8_t conf_field_size(conf_field_type type)
+{
+	switch (type)
+	{
+	case CONF_FIELD_UINT8:
+	case CONF_FIELD_INT8:
+	case CONF_FIELD_BOOL:
+		return 1;
+
+	case CONF_FIELD_UINT16:
+	case CONF_FIELD_INT16:
+	case CONF_FIELD_FLOAT16:
+		return 2;
+
+	default:
+		return 4;
+	}
+}
+
+static void conf_field_store(const VescUart::confField_t *field, const uint8_t *raw)
+{
+	int32_t index = 0;
+
+	switch (field->type)
+	{
+	case CONF_FIELD_UINT8:			*(uint8_t *)field->dest = raw[0]; break;
+	case CONF_FIELD_INT8:			*(int8_t *)field->dest = (int8_t)raw[0]; break;
+	case CONF_FIELD_BOOL:			*(bool *)field->dest = raw[0]; break;
+	case CONF_FIELD_UINT16:			*(uint16_t *)field->dest = buffer_get_uint16(raw, &index); break;
+	case CONF_FIELD_INT16:			*(int16_t *)field->dest = buffer_get_int16(raw, &index); break;
+	case CONF_FIELD_UINT32:			*(uint32_t *)field->dest = buffer_get_uint32(raw, &index); break;
+	case CONF_FIELD_INT32:			*(int32_t *)field->dest = buffer_get_int32(raw, &index); break;
+	case CONF_FIELD_FLOAT16:		*(float *)field->dest = buffer_get_float16(raw, field->scale, &index); break;
+	case CONF_FIELD_FLOAT32:		*(float *)field->dest = buffer_get_float32(raw, field->scale, &index); break;
+	case CONF_FIELD_FLOAT32_AUTO:	*(float *)field->dest = buffer_get_float32_auto(raw, &index); break;
+	}
+}
+
+void VescUart::confSink(void *context, const uint8_t *data, uint16_t len)
+{
+	confDecoder_t *dec = (confDecoder_t *)context;
+
+	for (uint16_t i = 0; i < len && dec->valid; i++)
+	{
+		uint16_t pos = dec->position++;
+
+		if (pos == 0)
+		{
+			dec->valid = (data[i] == dec->packetId);
+			continue;
+		}
+
+		// Offsets are relative to the serialised struct, after the packet id
+		uint16_t offset = pos - 1;
+
+		if (offset < sizeof(dec->signature))
+			dec->signature[offset] = data[i];
+
+		if (dec->current >= dec->count)
+			continue;
+
+		const confField_t *field = &dec->fields[dec->current];
+		if (offset < field->offset)
+			continue;
+
+		uint8_t size = conf_field_size(field->type);
+		dec->staging[dec->current][offset - field->offset] = data[i];
+
+		if (offset - field->offset == size - 1)
+			dec->current++;
+	}
+}
+
+bool VescUart::getConfiguration(COMM_PACKET_ID packetId, const confField_t *fields, uint8_t count, uint32_t signature, uint8_t canId)
+{
+	if (count > VESC_CONF_MAX_FIELDS)
+		return false;
+
+	// The decoder walks the fields with a single cursor, they must not overlap
+	for (uint8_t i = 1; i < count; i++)
+	{
+		if (fields[i].offset < fields[i - 1].offset + conf_field_size(fields[i - 1].type))
+		{
+			if (debugPort != NULL)
+				debugPort->printf("Configuration fields not sorted at %d\n", i);
+			return false;
+		}
+	}
+
+	int32_t index = 0;
+	uint8_t payload[3];
+
+	if (canId != 0)
+	{
+		payload[index++] = {COMM_FORWARD_CAN};
+		payload[index++] = canId;
+	}
+	payload[index++] = packetId;
+	packSendPayload(payload, index);
+
+	confDecoder_t dec;
+	dec.fields = fields;
+	dec.count = count;
+	dec.packetId = packetId;
+	dec.current = 0;
+	dec.position = 0;
+	dec.valid = true;
+
+	int messageLength = receiveUartStream(packetId, confSink, &dec);
+	if (debugPort != NULL)
+		debugPort->printf("message Length :%d\r\n", messageLength);
+
+	if (messageLength <= 0 || !dec.valid || dec.position < 1 + sizeof(dec.signature))
+		return false;
+
+	index = 0;
+	uint32_t received = buffer_get_uint32(dec.signature, &index);
+
+	if (signature != 0 && received != signature)
+	{
+		if (debugPort != NULL)
+			debugPort->printf("Configuration signature %u, expected %u\n", (unsigned)received, (unsigned)signature);
+		return false;
+	}
+
+	if (dec.current < count)
+	{
+		if (debugPort != NULL)
+			debugPort->printf("Configuration too short, got %d of %d fields\n", dec.current, count);
+		return false;
+	}
+
+	// CRC and signature are good, commit
+	confSignature = received;
+	for (uint8_t i = 0; i < count; i++)
+		conf_field_store(&fields[i], dec.staging[i]);
+
+	return true;
+}
+
+bool VescUart::getMcconf(const confField_t *fields, uint8_t count, uint32_t signature, uint8_t canId)
+{
+	if (debugPort != NULL)
+		debugPort->println("getMcconf();");
+
+	return getConfiguration(COMM_GET_MCCONF, fields, count, signature, canId);
+}
+
+bool VescUart::getAppconf(const confField_t *fields, uint8_t count, uint32_t signature, uint8_t canId)
+{
+	if (debugPort != NULL)
+		debugPort->println("getAppconf();");
+
+	return getConfiguration(COMM_GET_APPCONF, fields, count, signature, canId);
+}
+
+uint32_t VescUart::get_conf_signature(void)
+{
+	return confSignature;
+}
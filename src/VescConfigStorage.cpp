@@ -0,0 +1,63 @@
+#include "VescConfigStorage.h"
+
+#if !defined(ARDUINO) || defined(ESP_PLATFORM)
+
+VescFileConfigStorage::VescFileConfigStorage(const char *path) : path(path)
+{
+	snprintf(tmpPath, sizeof(tmpPath), "%s.tmp", path);
+}
+
+VescFileConfigStorage::~VescFileConfigStorage()
+{
+	end(false);
+}
+
+bool VescFileConfigStorage::begin(bool write)
+{
+	end(false);
+
+	writing = write;
+	file = fopen(write ? tmpPath : path, write ? "wb" : "rb");
+	return file != NULL;
+}
+
+int VescFileConfigStorage::read(uint8_t *data, uint16_t len)
+{
+	if (file == NULL || writing)
+		return 0;
+
+	return fread(data, 1, len, file);
+}
+
+bool VescFileConfigStorage::write(const uint8_t *data, uint16_t len)
+{
+	if (file == NULL || !writing)
+		return false;
+
+	return fwrite(data, 1, len, file) == len;
+}
+
+void VescFileConfigStorage::end(bool commit)
+{
+	if (file == NULL)
+		return;
+
+	bool ok = fclose(file) == 0;
+	file = NULL;
+
+	if (writing)
+	{
+		if (commit && ok)
+		{
+			remove(path);
+			rename(tmpPath, path);
+		}
+		else
+		{
+			remove(tmpPath);
+		}
+	}
+	writing = false;
+}
+
+#endif
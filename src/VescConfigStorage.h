@@ -0,0 +1,64 @@
+#ifndef _VESCCONFIGSTORAGE_h
+#define _VESCCONFIGSTORAGE_h
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * Backend that keeps the custom config XML between boots (see
+ * VescUart::customConfigSync()). An entry is written in one go between
+ * begin(true) and end(), and must only become visible when end(true) is called.
+ */
+class VescConfigStorage
+{
+public:
+  virtual ~VescConfigStorage() {}
+
+  /**
+   * @brief      Open the stored entry for reading, or start a new one
+   * @param      write  - True to start a new entry
+   * @return     False if there is no entry to read or it cannot be created
+   */
+  virtual bool begin(bool write) = 0;
+
+  /** Read the next len bytes, returns the number of bytes read */
+  virtual int read(uint8_t *data, uint16_t len) = 0;
+
+  /** Append len bytes to the entry being written */
+  virtual bool write(const uint8_t *data, uint16_t len) = 0;
+
+  /**
+   * @brief      Close the entry
+   * @param      commit  - When writing, true replaces the old entry, false drops the new one
+   */
+  virtual void end(bool commit) = 0;
+};
+
+#if !defined(ARDUINO) || defined(ESP_PLATFORM)
+#include <stdio.h>
+
+/**
+ * Keeps the entry in a file through stdio: a regular file on a host, or a file
+ * on a mounted VFS partition (e.g. "/spiffs/vesc.cfg" or "/sd/vesc.cfg") on ESP32.
+ * New entries are written to "<path>.tmp" and renamed over the old one.
+ */
+class VescFileConfigStorage : public VescConfigStorage
+{
+public:
+  VescFileConfigStorage(const char *path);
+  ~VescFileConfigStorage();
+
+  bool begin(bool write);
+  int read(uint8_t *data, uint16_t len);
+  bool write(const uint8_t *data, uint16_t len);
+  void end(bool commit);
+
+private:
+  const char *path;
+  char tmpPath[96];
+  FILE *file = NULL;
+  bool writing = false;
+};
+#endif
+
+#endif
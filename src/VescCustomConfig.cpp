@@ -0,0 +1,382 @@
+#include <stdint.h>
+#include "VescUart.h"
+
+/**
+ * Custom (package) configuration: COMM_GET_CUSTOM_CONFIG / COMM_SET_CUSTOM_CONFIG
+ * carry the serialised settings, COMM_GET_CUSTOM_CONFIG_XML their description.
+ *
+ * The XML is large and slow to read over UART, so it is kept in a
+ * VescConfigStorage. The stored entry starts with a 12 byte header
+ * (CUSTOM_CONFIG_MAGIC, config signature, XML size) followed by the XML as sent
+ * by the VESC. The signature is the first word of the binary config and changes
+ * with the layout of the config. The XML size is asked for on every sync, so the
+ * cache is used only when both signature and size match.
+ */
+
+#define CUSTOM_CONFIG_MAGIC 0x56435831 // "VCX1"
+#define CUSTOM_CONFIG_XML_HEADER 10 // id, conf_ind, size, offset
+
+// FNV-1a, only used to spread names over the index
+static uint16_t custom_name_hash(const char *name)
+{
+	uint32_t hash = 2166136261u;
+	while (*name)
+	{
+		hash ^= (uint8_t)*name++;
+		hash *= 16777619u;
+	}
+	return (uint16_t)(hash ^ (hash >> 16));
+}
+
+/** Context of the XML chunk sink: checks the reply header, writes the data to storage */
+struct xmlSink_t
+{
+	VescConfigStorage *storage;
+	uint8_t confInd;
+	int32_t offset;
+	uint16_t pos;
+	uint8_t header[CUSTOM_CONFIG_XML_HEADER];
+	bool valid;
+};
+
+static void xml_sink(void *context, const uint8_t *data, uint16_t len)
+{
+	xmlSink_t *sink = (xmlSink_t *)context;
+
+	while (len > 0 && sink->valid)
+	{
+		if (sink->pos < CUSTOM_CONFIG_XML_HEADER)
+		{
+			sink->header[sink->pos++] = *data++;
+			len--;
+
+			if (sink->pos == CUSTOM_CONFIG_XML_HEADER)
+			{
+				int32_t index = 6;
+				sink->valid = sink->header[0] == COMM_GET_CUSTOM_CONFIG_XML &&
+							  sink->header[1] == sink->confInd &&
+							  buffer_get_int32(sink->header, &index) == sink->offset;
+			}
+			continue;
+		}
+
+		sink->valid = sink->storage->write(data, len);
+		sink->pos += len;
+		len = 0;
+	}
+}
+
+void VescUart::customConfigXmlRequest(uint8_t confInd, uint8_t canId, int32_t len, int32_t offset)
+{
+	int32_t index = 0;
+	uint8_t payload[12];
+
+	if (canId != 0)
+	{
+		payload[index++] = {COMM_FORWARD_CAN};
+		payload[index++] = canId;
+	}
+	payload[index++] = {COMM_GET_CUSTOM_CONFIG_XML};
+	payload[index++] = confInd;
+	buffer_append_int32(payload, len, &index);
+	buffer_append_int32(payload, offset, &index);
+	packSendPayload(payload, index);
+}
+
+int32_t VescUart::customConfigXmlLength(uint8_t confInd, uint8_t canId)
+{
+	customConfigXmlRequest(confInd, canId, 0, 0);
+
+	uint8_t message[256];
+	int messageLength = receiveUartMessage(message);
+
+	if (messageLength < CUSTOM_CONFIG_XML_HEADER || message[0] != COMM_GET_CUSTOM_CONFIG_XML || message[1] != confInd)
+		return -1;
+
+	int32_t index = 2;
+	return buffer_get_int32(message, &index);
+}
+
+bool VescUart::customConfigDownloadXml(VescConfigStorage *storage, uint8_t confInd, uint8_t canId, int32_t size)
+{
+	if (!storage->begin(true))
+		return false;
+
+	uint8_t header[12];
+	int32_t index = 0;
+	buffer_append_uint32(header, CUSTOM_CONFIG_MAGIC, &index);
+	buffer_append_uint32(header, customConfigSignature(), &index);
+	buffer_append_uint32(header, size, &index);
+	bool ok = storage->write(header, sizeof(header));
+
+	// Keep up to VESC_CUSTOM_CONFIG_WINDOW requests in flight, the replies come
+	// back in order and are streamed straight into the storage.
+	int32_t requested = 0;
+	int32_t received = 0;
+	uint8_t inFlight = 0;
+
+	while (ok && received < size)
+	{
+		while (inFlight < VESC_CUSTOM_CONFIG_WINDOW && requested < size)
+		{
+			int32_t len = size - requested;
+			if (len > VESC_CUSTOM_CONFIG_CHUNK)
+				len = VESC_CUSTOM_CONFIG_CHUNK;
+
+			customConfigXmlRequest(confInd, canId, len, requested);
+			requested += len;
+			inFlight++;
+		}
+
+		xmlSink_t sink = {};
+		sink.storage = storage;
+		sink.confInd = confInd;
+		sink.offset = received;
+		sink.valid = true;
+
+		int messageLength = receiveUartStream(COMM_GET_CUSTOM_CONFIG_XML, xml_sink, &sink);
+		ok = messageLength > CUSTOM_CONFIG_XML_HEADER && sink.valid;
+
+		received += messageLength - CUSTOM_CONFIG_XML_HEADER;
+		inFlight--;
+
+		if (debugPort != NULL)
+			debugPort->printf("Custom config XML %d / %d\n", (int)received, (int)size);
+	}
+
+	storage->end(ok);
+
+	if (!ok)
+	{
+		if (inFlight > 0)
+			drainUart();
+		return false;
+	}
+
+	customConfigXmlSize = size;
+	return true;
+}
+
+void VescUart::setCustomConfigStorage(uint8_t *storage, uint16_t size)
+{
+	customConfig = storage;
+	customConfigSize = size;
+	customConfigLen = 0;
+}
+
+bool VescUart::customConfigRead(uint8_t confInd, uint8_t canId)
+{
+	if (customConfig == NULL)
+		return false;
+
+	int32_t index = 0;
+	uint8_t payload[4];
+
+	if (canId != 0)
+	{
+		payload[index++] = {COMM_FORWARD_CAN};
+		payload[index++] = canId;
+	}
+	payload[index++] = {COMM_GET_CUSTOM_CONFIG};
+	payload[index++] = confInd;
+	packSendPayload(payload, index);
+
+	const uint8_t expect[2] = {COMM_GET_CUSTOM_CONFIG, confInd};
+	copySink_t sink = {};
+	sink.expect = expect;
+	sink.expectLen = sizeof(expect);
+	sink.dst = customConfig;
+	sink.size = customConfigSize;
+	sink.valid = true;
+
+	// Received in place, the old config is gone if this fails
+	customConfigLen = 0;
+	int messageLength = receiveUartStream(COMM_GET_CUSTOM_CONFIG, copySink, &sink);
+
+	if (debugPort != NULL)
+		debugPort->printf("message Length :%d\r\n", messageLength);
+
+	if (messageLength < (int)sizeof(expect) + 4 || !sink.valid)
+		return false;
+
+	customConfigLen = messageLength - sizeof(expect);
+	return true;
+}
+
+bool VescUart::customConfigSync(VescConfigStorage *storage, uint8_t confInd, uint8_t canId)
+{
+	if (debugPort != NULL)
+		debugPort->println("customConfigSync();");
+
+	if (!customConfigRead(confInd, canId))
+		return false;
+
+	if (storage == NULL)
+		return true;
+
+	// One short request, the XML itself is only read when the cache is stale
+	int32_t size = customConfigXmlLength(confInd, canId);
+	if (size <= 0)
+		return false;
+
+	uint8_t header[12];
+	bool cached = false;
+
+	if (storage->begin(false))
+	{
+		if (storage->read(header, sizeof(header)) == sizeof(header))
+		{
+			int32_t index = 0;
+			uint32_t magic = buffer_get_uint32(header, &index);
+			uint32_t signature = buffer_get_uint32(header, &index);
+			uint32_t stored = buffer_get_uint32(header, &index);
+
+			if (magic == CUSTOM_CONFIG_MAGIC && signature == customConfigSignature() && stored == (uint32_t)size)
+			{
+				customConfigXmlSize = stored;
+				cached = true;
+			}
+		}
+		storage->end(false);
+	}
+
+	if (debugPort != NULL)
+		debugPort->printf("Custom config XML cached: %s\n", cached ? "true" : "false");
+
+	return cached || customConfigDownloadXml(storage, confInd, canId, size);
+}
+
+bool VescUart::setCustomConfigFields(const customField_t *fields, uint8_t count)
+{
+	static_assert((VESC_CUSTOM_CONFIG_INDEX_SIZE & (VESC_CUSTOM_CONFIG_INDEX_SIZE - 1)) == 0,
+				  "VESC_CUSTOM_CONFIG_INDEX_SIZE must be a power of two");
+	// Keep the index at most 3/4 full so probing stays short
+	if ((uint16_t)count * 4 > VESC_CUSTOM_CONFIG_INDEX_SIZE * 3)
+		return false;
+
+	memset(customIndex, 0, sizeof(customIndex));
+	customFields = fields;
+
+	for (uint8_t i = 0; i < count; i++)
+	{
+		uint16_t slot = custom_name_hash(fields[i].name) & (VESC_CUSTOM_CONFIG_INDEX_SIZE - 1);
+		while (customIndex[slot] != 0)
+			slot = (slot + 1) & (VESC_CUSTOM_CONFIG_INDEX_SIZE - 1);
+		customIndex[slot] = i + 1;
+	}
+
+	return true;
+}
+
+const VescUart::customField_t *VescUart::customConfigFind(const char *name)
+{
+	if (customFields == NULL)
+		return NULL;
+
+	uint16_t slot = custom_name_hash(name) & (VESC_CUSTOM_CONFIG_INDEX_SIZE - 1);
+	while (customIndex[slot] != 0)
+	{
+		const customField_t *field = &customFields[customIndex[slot] - 1];
+		if (strcmp(field->name, name) == 0)
+		{
+			if (field->offset + conf_field_size(field->type) > customConfigLen)
+				return NULL;
+			return field;
+		}
+		slot = (slot + 1) & (VESC_CUSTOM_CONFIG_INDEX_SIZE - 1);
+	}
+
+	return NULL;
+}
+
+float VescUart::get_custom_config(const char *name)
+{
+	const customField_t *field = customConfigFind(name);
+	if (field == NULL)
+		return NAN;
+
+	int32_t index = field->offset;
+
+	switch (field->type)
+	{
+	case CONF_FIELD_UINT8:			return customConfig[index];
+	case CONF_FIELD_INT8:			return (int8_t)customConfig[index];
+	case CONF_FIELD_BOOL:			return customConfig[index] ? 1.0 : 0.0;
+	case CONF_FIELD_UINT16:			return buffer_get_uint16(customConfig, &index);
+	case CONF_FIELD_INT16:			return buffer_get_int16(customConfig, &index);
+	case CONF_FIELD_UINT32:			return buffer_get_uint32(customConfig, &index);
+	case CONF_FIELD_INT32:			return buffer_get_int32(customConfig, &index);
+	case CONF_FIELD_FLOAT16:		return buffer_get_float16(customConfig, field->scale, &index);
+	case CONF_FIELD_FLOAT32:		return buffer_get_float32(customConfig, field->scale, &index);
+	case CONF_FIELD_FLOAT32_AUTO:	return buffer_get_float32_auto(customConfig, &index);
+	}
+
+	return NAN;
+}
+
+bool VescUart::set_custom_config(const char *name, float value)
+{
+	const customField_t *field = customConfigFind(name);
+	if (field == NULL)
+		return false;
+
+	int32_t index = field->offset;
+
+	switch (field->type)
+	{
+	case CONF_FIELD_UINT8:			customConfig[index] = (uint8_t)value; break;
+	case CONF_FIELD_INT8:			customConfig[index] = (uint8_t)(int8_t)value; break;
+	case CONF_FIELD_BOOL:			customConfig[index] = value != 0.0; break;
+	case CONF_FIELD_UINT16:			buffer_append_uint16(customConfig, (uint16_t)value, &index); break;
+	case CONF_FIELD_INT16:			buffer_append_int16(customConfig, (int16_t)value, &index); break;
+	case CONF_FIELD_UINT32:			buffer_append_uint32(customConfig, (uint32_t)value, &index); break;
+	case CONF_FIELD_INT32:			buffer_append_int32(customConfig, (int32_t)value, &index); break;
+	case CONF_FIELD_FLOAT16:		buffer_append_float16(customConfig, value, field->scale, &index); break;
+	case CONF_FIELD_FLOAT32:		buffer_append_float32(customConfig, value, field->scale, &index); break;
+	case CONF_FIELD_FLOAT32_AUTO:	buffer_append_float32_auto(customConfig, value, &index); break;
+	}
+
+	return true;
+}
+
+bool VescUart::customConfigWrite(uint8_t confInd, uint8_t canId)
+{
+	if (debugPort != NULL)
+		debugPort->println("customConfigWrite();");
+
+	if (customConfigLen == 0)
+		return false;
+
+	int32_t index = 0;
+	uint8_t payload[4];
+
+	if (canId != 0)
+	{
+		payload[index++] = {COMM_FORWARD_CAN};
+		payload[index++] = canId;
+	}
+	payload[index++] = {COMM_SET_CUSTOM_CONFIG};
+	payload[index++] = confInd;
+	packSendPayload(payload, index, customConfig, customConfigLen);
+
+	uint8_t message[256];
+	int messageLength = receiveUartMessage(message);
+
+	return messageLength >= 1 && message[0] == COMM_SET_CUSTOM_CONFIG;
+}
+
+uint32_t VescUart::customConfigSignature(void)
+{
+	int32_t index = 0;
+	return customConfigLen >= 4 ? buffer_get_uint32(customConfig, &index) : 0;
+}
+
+uint32_t VescUart::get_custom_config_signature(void)
+{
+	return customConfigSignature();
+}
+
+uint32_t VescUart::get_custom_config_xml_size(void)
+{
+	return customConfigXmlSize;
+}
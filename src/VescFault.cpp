@@ -0,0 +1,186 @@
+#include <stdint.h>
+#include "VescUart.h"
+
+/**
+ * Fault monitor. faultUpdate() asks for the fault code and the values that go
+ * with it in fault_data with COMM_GET_VALUES_SELECTIVE:
+ *
+ *   request  mask (uint32)
+ *   reply    mask (uint32), then the selected fields in bit order
+ *
+ * The reply is about 30 bytes, so it fits in a single short frame. Edges are
+ * reported to the fault callback as soon as they are decoded, so a warning
+ * sound can start before the caller looks at anything else.
+ */
+
+#define FAULT_MASK_TEMP_FET (1 << 0)
+#define FAULT_MASK_TEMP_MOTOR (1 << 1)
+#define FAULT_MASK_CURRENT (1 << 2)
+#define FAULT_MASK_CURRENT_IN (1 << 3)
+#define FAULT_MASK_DUTY (1 << 6)
+#define FAULT_MASK_RPM (1 << 7)
+#define FAULT_MASK_V_IN (1 << 8)
+#define FAULT_MASK_FAULT (1 << 15)
+
+#define FAULT_MASK (FAULT_MASK_TEMP_FET | FAULT_MASK_TEMP_MOTOR | FAULT_MASK_CURRENT | \
+					FAULT_MASK_CURRENT_IN | FAULT_MASK_DUTY | FAULT_MASK_RPM | FAULT_MASK_V_IN | FAULT_MASK_FAULT)
+
+// id, mask, then 2 + 2 + 4 + 4 + 2 + 4 + 2 + 1 bytes of fields
+#define FAULT_REPLY_LEN 26
+
+static const char *const faultNames[] = {
+	"NONE",
+	"OVER_VOLTAGE",
+	"UNDER_VOLTAGE",
+	"DRV",
+	"ABS_OVER_CURRENT",
+	"OVER_TEMP_FET",
+	"OVER_TEMP_MOTOR",
+	"GATE_DRIVER_OVER_VOLTAGE",
+	"GATE_DRIVER_UNDER_VOLTAGE",
+	"MCU_UNDER_VOLTAGE",
+	"BOOTING_FROM_WATCHDOG_RESET",
+	"ENCODER_SPI",
+	"ENCODER_SINCOS_BELOW_MIN_AMPLITUDE",
+	"ENCODER_SINCOS_ABOVE_MAX_AMPLITUDE",
+	"FLASH_CORRUPTION",
+	"HIGH_OFFSET_CURRENT_SENSOR_1",
+	"HIGH_OFFSET_CURRENT_SENSOR_2",
+	"HIGH_OFFSET_CURRENT_SENSOR_3",
+	"UNBALANCED_CURRENTS",
+	"BRK",
+	"RESOLVER_LOT",
+	"RESOLVER_DOS",
+	"RESOLVER_LOS",
+	"FLASH_CORRUPTION_APP_CFG",
+	"FLASH_CORRUPTION_MC_CFG",
+	"ENCODER_NO_MAGNET",
+	"ENCODER_MAGNET_TOO_STRONG",
+	"PHASE_FILTER",
+	"ENCODER_FAULT",
+	"LV_OUTPUT_FAULT",
+};
+
+const char *fault_code_name(mc_fault_code fault)
+{
+	if ((unsigned)fault >= sizeof(faultNames) / sizeof(faultNames[0]))
+		return "UNKNOWN";
+	return faultNames[fault];
+}
+
+void VescUart::setFaultCallback(faultCallback_t callback, void *context)
+{
+	faultCallback = callback;
+	faultContext = context;
+}
+
+VescUart::faultDevice_t *VescUart::faultDevice(uint8_t canId)
+{
+	for (uint8_t i = 0; i < VESC_FAULT_DEVICES; i++)
+	{
+		if (faultDevices[i].used && faultDevices[i].canId == canId)
+			return &faultDevices[i];
+	}
+
+	for (uint8_t i = 0; i < VESC_FAULT_DEVICES; i++)
+	{
+		if (!faultDevices[i].used)
+		{
+			faultDevices[i].used = true;
+			faultDevices[i].canId = canId;
+			faultDevices[i].fault = FAULT_CODE_NONE;
+			return &faultDevices[i];
+		}
+	}
+
+	return NULL;
+}
+
+void VescUart::faultDecode(const uint8_t *message, int lenPay, uint8_t canId)
+{
+	int32_t index = 1;
+	uint32_t mask = buffer_get_uint32(message, &index);
+
+	if (mask != FAULT_MASK || lenPay < FAULT_REPLY_LEN)
+		return;
+
+	faultEvent_t event;
+	event.canId = canId;
+	event.temp_fet = buffer_get_float16(message, 1e1, &index);
+	event.temp_motor = buffer_get_float16(message, 1e1, &index);
+	event.current = buffer_get_float32(message, 1e2, &index);
+	event.current_in = buffer_get_float32(message, 1e2, &index);
+	event.duty = buffer_get_float16(message, 1e3, &index);
+	event.rpm = buffer_get_float32(message, 1e0, &index);
+	event.voltage = buffer_get_float16(message, 1e1, &index);
+	event.fault = (mc_fault_code)message[index++];
+
+	faultDevice_t *device = faultDevice(canId);
+	if (device == NULL || device->fault == event.fault)
+		return;
+
+	event.previous = device->fault;
+	event.time = millis();
+	device->fault = event.fault;
+
+	faultHistory[faultHead] = event;
+	faultHead = (faultHead + 1) % VESC_FAULT_HISTORY;
+	faultCount++;
+
+	if (faultCallback != NULL)
+		faultCallback(faultContext, event);
+
+	if (debugPort != NULL)
+		debugPort->printf("Fault %s -> %s on %d\n", fault_code_name(event.previous), fault_code_name(event.fault), canId);
+}
+
+bool VescUart::faultUpdate(uint8_t canId)
+{
+	int32_t index = 0;
+	uint8_t payload[7];
+
+	if (canId != 0)
+	{
+		payload[index++] = {COMM_FORWARD_CAN};
+		payload[index++] = canId;
+	}
+	payload[index++] = {COMM_GET_VALUES_SELECTIVE};
+	buffer_append_uint32(payload, FAULT_MASK, &index);
+	packSendPayload(payload, index);
+
+	uint8_t message[256];
+	int messageLength = receiveUartMessage(message);
+
+	if (messageLength < FAULT_REPLY_LEN || message[0] != COMM_GET_VALUES_SELECTIVE)
+		return false;
+
+	faultDecode(message, messageLength, canId);
+	return true;
+}
+
+mc_fault_code VescUart::get_fault_code(uint8_t canId)
+{
+	for (uint8_t i = 0; i < VESC_FAULT_DEVICES; i++)
+	{
+		if (faultDevices[i].used && faultDevices[i].canId == canId)
+			return faultDevices[i].fault;
+	}
+	return FAULT_CODE_NONE;
+}
+
+uint8_t VescUart::get_fault_history(faultEvent_t *events, uint8_t max)
+{
+	uint8_t count = faultCount < VESC_FAULT_HISTORY ? faultCount : VESC_FAULT_HISTORY;
+	if (count > max)
+		count = max;
+
+	for (uint8_t i = 0; i < count; i++)
+		events[i] = faultHistory[(faultHead + VESC_FAULT_HISTORY - 1 - i) % VESC_FAULT_HISTORY];
+
+	return count;
+}
+
+uint32_t VescUart::get_fault_count(void)
+{
+	return faultCount;
+}
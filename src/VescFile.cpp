@@ -0,0 +1,333 @@
+#include <stdint.h>
+#include "VescUart.h"
+
+/**
+ * File system access (COMM_FILE_*), as used by VESC Tool:
+ *
+ *   COMM_FILE_LIST    path, [from]               -> more, {is_dir, size (int32), name}...
+ *   COMM_FILE_READ    path, offset (int32)        -> offset, file size (int32), data
+ *   COMM_FILE_WRITE   path, offset, size, data    -> offset, ok
+ *   COMM_FILE_MKDIR   path                        -> ok
+ *   COMM_FILE_REMOVE  path                        -> ok
+ *
+ * The VESC decides how much a read returns, so the first reply sets the chunk
+ * size the following pipelined requests use.
+ */
+
+#define FILE_READ_HEADER 9 // id, offset, size
+#define FILE_REPLY_MAX 512
+
+// Kept off the stack (about 1.6 KB together), one write runs at a time
+static uint8_t file_window[VESC_FILE_WINDOW][VESC_FILE_CHUNK];
+static uint8_t file_payload[VESC_FILE_MAX_PATH + 12 + VESC_FILE_CHUNK];
+static bool file_busy = false;
+
+int VescUart::filePathPayload(uint8_t *payload, COMM_PACKET_ID packetId, const char *path, uint8_t canId)
+{
+	int32_t index = 0;
+
+	if (canId != 0)
+	{
+		payload[index++] = {COMM_FORWARD_CAN};
+		payload[index++] = canId;
+	}
+	payload[index++] = packetId;
+
+	size_t len = strlen(path);
+	if (len >= VESC_FILE_MAX_PATH)
+		len = VESC_FILE_MAX_PATH - 1;
+	memcpy(payload + index, path, len);
+	index += len;
+	payload[index++] = 0;
+
+	return index;
+}
+
+void VescUart::fileReadRequest(const char *path, uint32_t offset, uint8_t canId)
+{
+	uint8_t payload[VESC_FILE_MAX_PATH + 8];
+	int32_t index = filePathPayload(payload, COMM_FILE_READ, path, canId);
+	buffer_append_int32(payload, offset, &index);
+	packSendPayload(payload, index);
+}
+
+void VescUart::fileWriteRequest(const char *path, uint32_t offset, uint32_t size, const uint8_t *data, uint16_t len, uint8_t canId)
+{
+	uint8_t *payload = file_payload;
+	int32_t index = filePathPayload(payload, COMM_FILE_WRITE, path, canId);
+	buffer_append_int32(payload, offset, &index);
+	buffer_append_int32(payload, size, &index);
+	memcpy(payload + index, data, len);
+	index += len;
+	packSendPayload(payload, index);
+}
+
+bool VescUart::fileSimpleCommand(COMM_PACKET_ID packetId, const char *path, uint8_t canId)
+{
+	uint8_t payload[VESC_FILE_MAX_PATH + 4];
+	packSendPayload(payload, filePathPayload(payload, packetId, path, canId));
+
+	uint8_t message[256];
+	int messageLength = receiveUartMessage(message);
+
+	return messageLength >= 2 && message[0] == packetId && message[1];
+}
+
+bool VescUart::fileMkdir(const char *path, uint8_t canId)
+{
+	return fileSimpleCommand(COMM_FILE_MKDIR, path, canId);
+}
+
+bool VescUart::fileRemove(const char *path, uint8_t canId)
+{
+	return fileSimpleCommand(COMM_FILE_REMOVE, path, canId);
+}
+
+int VescUart::fileList(const char *path, fileEntry_t *entries, uint8_t max, const char *from, bool *more, uint8_t canId)
+{
+	uint8_t payload[2 * VESC_FILE_MAX_PATH + 4];
+	int32_t index = filePathPayload(payload, COMM_FILE_LIST, path, canId);
+
+	if (from != NULL)
+	{
+		size_t len = strlen(from);
+		if (len >= VESC_FILE_MAX_PATH)
+			len = VESC_FILE_MAX_PATH - 1;
+		memcpy(payload + index, from, len);
+		index += len;
+		payload[index++] = 0;
+	}
+	packSendPayload(payload, index);
+
+	uint8_t message[FILE_REPLY_MAX];
+	const uint8_t expect[1] = {COMM_FILE_LIST};
+	copySink_t sink = {};
+	sink.expect = expect;
+	sink.expectLen = sizeof(expect);
+	sink.dst = message;
+	sink.size = sizeof(message);
+	sink.valid = true;
+
+	int messageLength = receiveUartStream(COMM_FILE_LIST, copySink, &sink);
+	if (messageLength < 2 || !sink.valid)
+		return -1;
+
+	int32_t len = messageLength - 1;
+	index = 0;
+	if (more != NULL)
+		*more = message[index];
+	index++;
+
+	int count = 0;
+	while (index + 5 < len && count < max)
+	{
+		fileEntry_t *entry = &entries[count];
+		entry->isDir = message[index++];
+		entry->size = buffer_get_int32(message, &index);
+
+		const char *name = (const char *)message + index;
+		size_t nameLen = strnlen(name, len - index);
+		if (index + (int32_t)nameLen >= len)
+			break;
+
+		strncpy(entry->name, name, sizeof(entry->name) - 1);
+		entry->name[sizeof(entry->name) - 1] = 0;
+		index += nameLen + 1;
+		count++;
+	}
+
+	return count;
+}
+
+bool VescUart::fileRead(const char *path, Print *out, uint32_t offset, uint8_t canId)
+{
+	if (debugPort != NULL)
+		debugPort->printf("fileRead(); %s from %u\n", path, (unsigned)offset);
+
+	fileProgress = offset;
+	fileCrc = 0;
+
+	uint8_t message[FILE_REPLY_MAX];
+	const uint8_t expect[1] = {COMM_FILE_READ};
+	uint32_t chunk = 0;	// set by the first reply
+	uint32_t next = offset; // next offset to request once chunk is known
+	uint8_t inFlight = 1;
+	uint8_t retries = 0;
+
+	fileReadRequest(path, offset, canId);
+
+	for (;;)
+	{
+		copySink_t sink = {};
+		sink.expect = expect;
+		sink.expectLen = sizeof(expect);
+		sink.dst = message;
+		sink.size = sizeof(message);
+		sink.valid = true;
+
+		int messageLength = receiveUartStream(COMM_FILE_READ, copySink, &sink);
+		bool ok = messageLength >= FILE_READ_HEADER && sink.valid;
+		int32_t index = 0;
+		uint32_t replyOffset = 0;
+
+		if (ok)
+		{
+			replyOffset = buffer_get_int32(message, &index);
+			fileSize = buffer_get_int32(message, &index);
+			ok = replyOffset == fileProgress;
+		}
+
+		uint16_t dataLen = ok ? messageLength - FILE_READ_HEADER : 0;
+
+		// A short chunk that is not the last one means the VESC changed its chunk
+		// size, the requests in flight are for the wrong offsets then.
+		if (ok && chunk != 0 && dataLen != chunk && fileProgress + dataLen < fileSize)
+			ok = false;
+
+		if (!ok || (dataLen == 0 && fileProgress < fileSize))
+		{
+			if (++retries > VESC_FILE_RETRIES)
+			{
+				if (debugPort != NULL)
+					debugPort->printf("File read failed at %u\n", (unsigned)fileProgress);
+				if (inFlight > 1)
+					drainUart();
+				return false;
+			}
+
+			// Start over at the first missing byte without pipelining
+			drainUart();
+			fileReadRequest(path, fileProgress, canId);
+			inFlight = 1;
+			chunk = 0;
+			continue;
+		}
+
+		out->write(message + index, dataLen);
+		fileCrc = crc16_continue(fileCrc, message + index, dataLen);
+		fileProgress += dataLen;
+		inFlight--;
+		retries = 0;
+
+		if (fileProgress >= fileSize)
+			return true;
+
+		if (chunk == 0)
+		{
+			chunk = dataLen;
+			next = fileProgress + inFlight * chunk;
+		}
+
+		while (inFlight < VESC_FILE_WINDOW && next < fileSize)
+		{
+			fileReadRequest(path, next, canId);
+			next += chunk;
+			inFlight++;
+		}
+	}
+}
+
+bool VescUart::fileWrite(const char *path, Stream *in, uint32_t size, uint32_t offset, uint8_t canId)
+{
+	if (debugPort != NULL)
+		debugPort->printf("fileWrite(); %s %u from %u\n", path, (unsigned)size, (unsigned)offset);
+
+	if (in == NULL || offset > size || file_busy)
+		return false;
+
+	file_busy = true;
+	bool ok = fileTransfer(path, in, size, offset, canId);
+	file_busy = false;
+	return ok;
+}
+
+bool VescUart::fileTransfer(const char *path, Stream *in, uint32_t size, uint32_t offset, uint8_t canId)
+{
+	uint8_t (*window)[VESC_FILE_CHUNK] = file_window;
+	uint16_t windowLen[VESC_FILE_WINDOW];
+	uint8_t oldest = 0;
+	uint8_t inFlight = 0;
+	uint8_t retries = 0;
+	uint32_t sent = offset;
+
+	fileProgress = offset;
+	fileCrc = 0;
+
+	// An empty file still needs one write to be created
+	bool empty = size == 0;
+
+	while (fileProgress < size || empty)
+	{
+		while (inFlight < VESC_FILE_WINDOW && (sent < size || empty))
+		{
+			uint8_t slot = (oldest + inFlight) % VESC_FILE_WINDOW;
+			uint16_t len = size - sent > VESC_FILE_CHUNK ? VESC_FILE_CHUNK : size - sent;
+
+			if (in->readBytes(window[slot], len) != len)
+			{
+				if (inFlight > 0)
+					drainUart();
+				return false;
+			}
+
+			fileCrc = crc16_continue(fileCrc, window[slot], len);
+			windowLen[slot] = len;
+			fileWriteRequest(path, sent, size, window[slot], len, canId);
+			sent += len;
+			inFlight++;
+			empty = false;
+		}
+
+		uint8_t message[256];
+		int messageLength = receiveUartMessage(message);
+		int32_t index = 1;
+
+		if (messageLength >= 6 && message[0] == COMM_FILE_WRITE &&
+			(uint32_t)buffer_get_int32(message, &index) == fileProgress && message[5])
+		{
+			fileProgress += windowLen[oldest];
+			oldest = (oldest + 1) % VESC_FILE_WINDOW;
+			inFlight--;
+			retries = 0;
+
+			if (size == 0)
+				return true;
+			continue;
+		}
+
+		if (++retries > VESC_FILE_RETRIES)
+		{
+			if (debugPort != NULL)
+				debugPort->printf("File write failed at %u\n", (unsigned)fileProgress);
+			drainUart();
+			return false;
+		}
+
+		// Go back to the oldest unacknowledged chunk and send the window again
+		drainUart();
+		uint32_t resend = fileProgress;
+		for (uint8_t i = 0; i < inFlight; i++)
+		{
+			uint8_t slot = (oldest + i) % VESC_FILE_WINDOW;
+			fileWriteRequest(path, resend, size, window[slot], windowLen[slot], canId);
+			resend += windowLen[slot];
+		}
+	}
+
+	return true;
+}
+
+uint32_t VescUart::get_file_progress(void)
+{
+	return fileProgress;
+}
+
+uint32_t VescUart::get_file_size(void)
+{
+	return fileSize;
+}
+
+uint16_t VescUart::get_file_crc(void)
+{
+	return fileCrc;
+}
@@ -0,0 +1,258 @@
+#include <stdint.h>
+#include "VescUart.h"
+
+/**
+ * Firmware upload to the new app area, the same way VESC Tool does it:
+ * COMM_ERASE_NEW_APP with the size, then COMM_WRITE_NEW_APP_DATA(_LZO) chunks.
+ * The area starts with a 6 byte header (image size, CRC16 of the image) that
+ * the bootloader checks, the image itself follows at offset FW_HEADER_SIZE.
+ *
+ * Writes are acknowledged with [id, ok, offset]. Up to VESC_FW_WINDOW writes
+ * are in flight; when an ack is missing or negative the whole window is sent
+ * again from the oldest unacknowledged chunk (go-back-N).
+ */
+
+#define FW_HEADER_SIZE 6
+
+// Kept off the stack (about 2 KB together), one upload runs at a time
+static uint8_t fw_window[VESC_FW_WINDOW][VESC_FW_CHUNK];
+static uint8_t fw_payload[VESC_FW_CHUNK + 9];
+static bool fw_busy = false;
+
+void VescUart::setFirmwareCompressor(fwCompress_t compress)
+{
+	fwCompress = compress;
+}
+
+uint32_t VescUart::get_firmware_progress(void)
+{
+	return fwProgress;
+}
+
+bool VescUart::firmwareErase(uint32_t size, uint8_t canId)
+{
+	int32_t index = 0;
+	uint8_t payload[7];
+
+	if (canId != 0)
+	{
+		payload[index++] = {COMM_FORWARD_CAN};
+		payload[index++] = canId;
+	}
+	payload[index++] = {COMM_ERASE_NEW_APP};
+	buffer_append_uint32(payload, size, &index);
+	packSendPayload(payload, index);
+
+	// Erasing takes seconds, keep listening past the normal timeout
+	uint8_t message[256];
+	uint32_t start = millis();
+
+	while (millis() - start < VESC_FW_ERASE_TIMEOUT)
+	{
+		int messageLength = receiveUartMessage(message);
+
+		if (messageLength >= 2 && message[0] == COMM_ERASE_NEW_APP)
+			return message[1];
+	}
+
+	if (debugPort != NULL)
+		debugPort->println("Erase timeout");
+
+	return false;
+}
+
+void VescUart::firmwareSendChunk(uint32_t offset, const uint8_t *data, uint16_t len, uint8_t canId)
+{
+	int32_t index = 0;
+	uint8_t *payload = fw_payload;
+
+	if (canId != 0)
+	{
+		payload[index++] = {COMM_FORWARD_CAN};
+		payload[index++] = canId;
+	}
+
+	uint16_t compressed = 0;
+	if (fwCompress != NULL)
+	{
+		// Leave room for the id, offset and decompressed length in front
+		compressed = fwCompress(data, len, payload + index + 7, VESC_FW_CHUNK);
+		if (compressed >= len)
+			compressed = 0;
+	}
+
+	if (compressed > 0)
+	{
+		payload[index++] = {COMM_WRITE_NEW_APP_DATA_LZO};
+		buffer_append_uint32(payload, offset, &index);
+		buffer_append_uint16(payload, len, &index);
+		index += compressed;
+	}
+	else
+	{
+		payload[index++] = {COMM_WRITE_NEW_APP_DATA};
+		buffer_append_uint32(payload, offset, &index);
+		memcpy(payload + index, data, len);
+		index += len;
+	}
+
+	packSendPayload(payload, index);
+}
+
+int VescUart::firmwareAck(uint32_t *offset)
+{
+	uint8_t message[256];
+	int messageLength = receiveUartMessage(message);
+
+	if (messageLength < 2)
+		return -1;
+
+	if (message[0] != COMM_WRITE_NEW_APP_DATA && message[0] != COMM_WRITE_NEW_APP_DATA_LZO)
+		return 0;
+
+	// Old firmware does not echo the offset
+	if (messageLength >= 6)
+	{
+		int32_t index = 2;
+		*offset = buffer_get_uint32(message, &index);
+	}
+
+	return message[1] ? 1 : 0;
+}
+
+bool VescUart::firmwareUpload(Stream *image, uint32_t size, uint16_t expectedCrc, uint32_t resumeOffset, uint8_t canId)
+{
+	if (debugPort != NULL)
+		debugPort->printf("firmwareUpload(); size %u from %u\n", (unsigned)size, (unsigned)resumeOffset);
+
+	if (image == NULL || resumeOffset > size || fw_busy)
+		return false;
+
+	fw_busy = true;
+	bool ok = firmwareTransfer(image, size, expectedCrc, resumeOffset, canId);
+	fw_busy = false;
+	return ok;
+}
+
+bool VescUart::firmwareTransfer(Stream *image, uint32_t size, uint16_t expectedCrc, uint32_t resumeOffset, uint8_t canId)
+{
+	if (resumeOffset == 0)
+	{
+		fwProgress = 0;
+		if (!firmwareErase(size + FW_HEADER_SIZE, canId))
+			return false;
+	}
+
+	// The CRC covers the whole image, run it over the part that is already written
+	uint8_t (*window)[VESC_FW_CHUNK] = fw_window;
+	uint16_t crc = 0;
+	uint32_t skipped = 0;
+
+	while (skipped < resumeOffset)
+	{
+		uint16_t len = resumeOffset - skipped > VESC_FW_CHUNK ? VESC_FW_CHUNK : resumeOffset - skipped;
+		if (image->readBytes(window[0], len) != len)
+			return false;
+		crc = crc16_continue(crc, window[0], len);
+		skipped += len;
+	}
+
+	uint16_t windowLen[VESC_FW_WINDOW];
+	uint8_t oldest = 0;
+	uint8_t inFlight = 0;
+	uint8_t retries = 0;
+	uint32_t acked = resumeOffset;
+	uint32_t sent = resumeOffset;
+
+	while (acked < size)
+	{
+		while (inFlight < VESC_FW_WINDOW && sent < size)
+		{
+			uint8_t slot = (oldest + inFlight) % VESC_FW_WINDOW;
+			uint16_t len = size - sent > VESC_FW_CHUNK ? VESC_FW_CHUNK : size - sent;
+
+			if (image->readBytes(window[slot], len) != len)
+			{
+				if (debugPort != NULL)
+					debugPort->println("Image read failed");
+				drainUart();
+				return false;
+			}
+
+			crc = crc16_continue(crc, window[slot], len);
+			windowLen[slot] = len;
+			firmwareSendChunk(FW_HEADER_SIZE + sent, window[slot], len, canId);
+			sent += len;
+			inFlight++;
+		}
+
+		uint32_t offset = FW_HEADER_SIZE + acked;
+		int ack = firmwareAck(&offset);
+
+		if (ack == 1 && offset == FW_HEADER_SIZE + acked)
+		{
+			acked += windowLen[oldest];
+			fwProgress = acked;
+			oldest = (oldest + 1) % VESC_FW_WINDOW;
+			inFlight--;
+			retries = 0;
+			continue;
+		}
+
+		if (++retries > VESC_FW_RETRIES)
+		{
+			if (debugPort != NULL)
+				debugPort->printf("Upload failed at %u\n", (unsigned)acked);
+			drainUart();
+			return false;
+		}
+
+		// Go back to the oldest unacknowledged chunk and send the window again
+		drainUart();
+		uint32_t resend = acked;
+		for (uint8_t i = 0; i < inFlight; i++)
+		{
+			uint8_t slot = (oldest + i) % VESC_FW_WINDOW;
+			firmwareSendChunk(FW_HEADER_SIZE + resend, window[slot], windowLen[slot], canId);
+			resend += windowLen[slot];
+		}
+	}
+
+	if (expectedCrc != 0 && crc != expectedCrc)
+	{
+		if (debugPort != NULL)
+			debugPort->printf("Image CRC %u, expected %u\n", crc, expectedCrc);
+		return false;
+	}
+
+	// Header last: the bootloader only accepts the image once this is in place
+	uint8_t header[FW_HEADER_SIZE];
+	int32_t index = 0;
+	buffer_append_uint32(header, size, &index);
+	buffer_append_uint16(header, crc, &index);
+
+	for (uint8_t i = 0; i <= VESC_FW_RETRIES; i++)
+	{
+		uint32_t offset = 0;
+		firmwareSendChunk(0, header, sizeof(header), canId);
+
+		if (firmwareAck(&offset) == 1 && offset == 0)
+			return true;
+	}
+
+	return false;
+}
+
+void VescUart::firmwareJumpToBootloader(uint8_t canId)
+{
+	int32_t index = 0;
+	uint8_t payload[3];
+
+	if (canId != 0)
+	{
+		payload[index++] = {COMM_FORWARD_CAN};
+		payload[index++] = canId;
+	}
+	payload[index++] = {COMM_JUMP_TO_BOOTLOADER};
+	packSendPayload(payload, index);
+}
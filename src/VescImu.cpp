@@ -0,0 +1,146 @@
+#include <stdint.h>
+#include "VescUart.h"
+
+/**
+ * COMM_GET_IMU_DATA  mask (uint16)
+ *                    -> mask (uint16), float32_auto for each bit set:
+ *                       roll, pitch, yaw, acc xyz, gyro xyz, mag xyz, q0..q3
+ *
+ * Samples go into a ring of VESC_IMU_HISTORY entries with their receive time.
+ */
+
+static float *imu_axis(VescUart::imuData_t *data, uint8_t bit)
+{
+	if (bit < 3)
+		return &data->rpy[bit];
+	if (bit < 6)
+		return &data->acc[bit - 3];
+	if (bit < 9)
+		return &data->gyro[bit - 6];
+	if (bit < 12)
+		return &data->mag[bit - 9];
+	return &data->q[bit - 12];
+}
+
+static float imu_lerp_angle(float a, float b, float t)
+{
+	float diff = b - a;
+	if (diff > M_PI)
+		diff -= 2.0 * M_PI;
+	else if (diff < -M_PI)
+		diff += 2.0 * M_PI;
+
+	float angle = a + diff * t;
+	if (angle > M_PI)
+		angle -= 2.0 * M_PI;
+	else if (angle < -M_PI)
+		angle += 2.0 * M_PI;
+	return angle;
+}
+
+bool VescUart::imuUpdate(uint16_t mask, uint8_t canId)
+{
+	int32_t index = 0;
+	uint8_t payload[5];
+
+	if (canId != 0)
+	{
+		payload[index++] = {COMM_FORWARD_CAN};
+		payload[index++] = canId;
+	}
+	payload[index++] = {COMM_GET_IMU_DATA};
+	buffer_append_uint16(payload, mask, &index);
+	packSendPayload(payload, index);
+
+	uint8_t message[256];
+	int messageLength = receiveUartMessage(message);
+
+	if (messageLength < 3 || message[0] != COMM_GET_IMU_DATA)
+		return false;
+
+	imuData_t sample = {};
+	index = 1;
+	sample.mask = buffer_get_uint16(message, &index);
+
+	for (uint8_t bit = 0; bit < 16; bit++)
+	{
+		if (!(sample.mask & (1 << bit)))
+			continue;
+		if (index + 4 > messageLength)
+			return false;
+		*imu_axis(&sample, bit) = buffer_get_float32_auto(message, &index);
+	}
+
+	sample.time = millis();
+	imuHead = imuCount == 0 ? 0 : (imuHead + 1) % VESC_IMU_HISTORY;
+	imuHistory[imuHead] = sample;
+	if (imuCount < VESC_IMU_HISTORY)
+		imuCount++;
+
+	return true;
+}
+
+const VescUart::imuData_t &VescUart::get_imu_data(void)
+{
+	return imuHistory[imuHead];
+}
+
+bool VescUart::imuInterpolate(uint32_t time, imuData_t *out)
+{
+	if (imuCount == 0)
+		return false;
+
+	// Walk from the newest sample back to the first one not after time
+	const imuData_t *newer = &imuHistory[imuHead];
+	const imuData_t *older = newer;
+
+	for (uint8_t age = 0; age < imuCount; age++)
+	{
+		older = &imuHistory[(imuHead + VESC_IMU_HISTORY - age) % VESC_IMU_HISTORY];
+		if ((int32_t)(time - older->time) >= 0)
+			break;
+		newer = older;
+	}
+
+	if (older == newer || (int32_t)(time - older->time) < 0)
+	{
+		*out = *older;
+		return true;
+	}
+
+	float t = (float)(time - older->time) / (float)(newer->time - older->time);
+	imuData_t result = *newer;
+	result.time = time;
+	result.mask = older->mask & newer->mask;
+
+	for (uint8_t i = 0; i < 3; i++)
+	{
+		result.rpy[i] = imu_lerp_angle(older->rpy[i], newer->rpy[i], t);
+		result.acc[i] = older->acc[i] + (newer->acc[i] - older->acc[i]) * t;
+		result.gyro[i] = older->gyro[i] + (newer->gyro[i] - older->gyro[i]) * t;
+		result.mag[i] = older->mag[i] + (newer->mag[i] - older->mag[i]) * t;
+	}
+
+	// Normalised linear interpolation, on the same hemisphere
+	float dot = 0.0;
+	for (uint8_t i = 0; i < 4; i++)
+		dot += older->q[i] * newer->q[i];
+
+	float norm = 0.0;
+	for (uint8_t i = 0; i < 4; i++)
+	{
+		float q = dot < 0.0 ? -newer->q[i] : newer->q[i];
+		result.q[i] = older->q[i] + (q - older->q[i]) * t;
+		norm += result.q[i] * result.q[i];
+	}
+
+	if (norm > 0.0)
+	{
+		norm = sqrtf(norm);
+		for (uint8_t i = 0; i < 4; i++)
+			result.q[i] /= norm;
+	}
+
+	*out = result;
+	return true;
+}
@@ -0,0 +1,97 @@
+#include <stdint.h>
+#include "VescUart.h"
+
+/**
+ * Ride modes switch limits with COMM_SET_MCCONF_TEMP(_SETUP), which only carries
+ * the limit block instead of the whole mc_configuration. The payload always holds
+ * the full block, so the saving for unchanged values is done by not sending at all
+ * when the requested limits equal the ones acknowledged last for the same target.
+ */
+
+bool VescUart::sendTempLimits(COMM_PACKET_ID packetId, const tempLimits_t &limits, bool forwardCan, bool store, uint8_t canId, bool divide)
+{
+	// Skipping is only safe for the same controller and the same forwarding to the CAN bus
+	if (!store && tempLimitsPacket == packetId && tempLimitsDivide == divide && tempLimitsForward == forwardCan &&
+		tempLimitsCanId == canId && memcmp(&tempLimits, &limits, sizeof(limits)) == 0)
+	{
+		if (debugPort != NULL)
+			debugPort->println("Limits unchanged, not sent");
+		tempLimitsLatency = 0;
+		return true;
+	}
+
+	int32_t index = 0;
+	uint8_t payload[48];
+
+	if (canId != 0)
+	{
+		payload[index++] = {COMM_FORWARD_CAN};
+		payload[index++] = canId;
+	}
+	payload[index++] = packetId;
+	payload[index++] = store;
+	payload[index++] = forwardCan;
+	payload[index++] = true; // ack
+	payload[index++] = divide; // watt limits divided by the number of controllers
+	buffer_append_float32_auto(payload, limits.current_min_scale, &index);
+	buffer_append_float32_auto(payload, limits.current_max_scale, &index);
+	buffer_append_float32_auto(payload, limits.min_erpm, &index);
+	buffer_append_float32_auto(payload, limits.max_erpm, &index);
+	buffer_append_float32_auto(payload, limits.min_duty, &index);
+	buffer_append_float32_auto(payload, limits.max_duty, &index);
+	buffer_append_float32_auto(payload, limits.watt_min, &index);
+	buffer_append_float32_auto(payload, limits.watt_max, &index);
+	buffer_append_float32_auto(payload, limits.in_current_min, &index);
+	buffer_append_float32_auto(payload, limits.in_current_max, &index);
+
+	uint32_t start = micros();
+	packSendPayload(payload, index);
+
+	uint8_t message[256];
+	int messageLength = receiveUartMessage(message);
+	uint32_t latency = micros() - start;
+
+	if (debugPort != NULL)
+		debugPort->printf("message Length :%d latency :%u us\r\n", messageLength, (unsigned)latency);
+
+	if (messageLength >= 1 && message[0] == packetId)
+	{
+		tempLimits = limits;
+		tempLimitsPacket = packetId;
+		tempLimitsDivide = divide;
+		tempLimitsForward = forwardCan;
+		tempLimitsCanId = canId;
+		tempLimitsLatency = latency;
+		return true;
+	}
+
+	// State on the VESC is unknown now, send the next request in full
+	tempLimitsPacket = 0;
+	return false;
+}
+
+bool VescUart::setMcconfTemp(const tempLimits_t &limits, bool forwardCan, bool store, uint8_t canId)
+{
+	if (debugPort != NULL)
+		debugPort->println("setMcconfTemp();");
+
+	return sendTempLimits(COMM_SET_MCCONF_TEMP, limits, forwardCan, store, canId, false);
+}
+
+bool VescUart::setMcconfTempSetup(const tempLimits_t &limits, bool forwardCan, bool store, uint8_t canId, bool divide)
+{
+	if (debugPort != NULL)
+		debugPort->println("setMcconfTempSetup();");
+
+	return sendTempLimits(COMM_SET_MCCONF_TEMP_SETUP, limits, forwardCan, store, canId, divide);
+}
+
+const VescUart::tempLimits_t &VescUart::get_temp_limits(void)
+{
+	return tempLimits;
+}
+
+uint32_t VescUart::get_temp_limits_latency(void)
+{
+	return tempLimitsLatency;
+}
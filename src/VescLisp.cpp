@@ -0,0 +1,241 @@
+#include <stdint.h>
+#include "VescUart.h"
+
+/**
+ * LispBM support:
+ *
+ *   COMM_LISP_STREAM_CODE  offset (int32), total size (int32), restart, code
+ *                          -> offset (int32), result (int16, negative on error)
+ *   COMM_LISP_REPL_CMD     expression, the output comes back as COMM_LISP_PRINT
+ *   COMM_LISP_PRINT        text, sent by the VESC at any time
+ *   COMM_LISP_GET_STATS    -> cpu, heap, mem, stack (float16 1e2), done_ctx_r,
+ *                             {name, value (float32_auto)}...
+ *
+ * A stream chunk is only acknowledged once LispBM has read it, so a negative
+ * result means the reader is busy and the chunk has to be sent again.
+ */
+
+// Kept off the stack (about 1.2 KB together), one stream runs at a time
+static uint8_t lisp_window[VESC_LISP_WINDOW][VESC_LISP_CHUNK];
+static uint8_t lisp_payload[VESC_LISP_CHUNK + 12];
+static bool lisp_busy = false;
+
+void VescUart::lispStreamChunk(uint32_t offset, uint32_t size, uint8_t restart, const uint8_t *data, uint16_t len, uint8_t canId)
+{
+	int32_t index = 0;
+	uint8_t *payload = lisp_payload;
+
+	if (canId != 0)
+	{
+		payload[index++] = {COMM_FORWARD_CAN};
+		payload[index++] = canId;
+	}
+	payload[index++] = {COMM_LISP_STREAM_CODE};
+	buffer_append_int32(payload, offset, &index);
+	buffer_append_int32(payload, size, &index);
+	payload[index++] = offset == 0 ? restart : 0;
+	memcpy(payload + index, data, len);
+	index += len;
+	packSendPayload(payload, index);
+}
+
+bool VescUart::lispStreamCode(Stream *code, uint32_t size, uint8_t restart, uint8_t canId)
+{
+	if (debugPort != NULL)
+		debugPort->printf("lispStreamCode(); %u bytes\n", (unsigned)size);
+
+	if (code == NULL || size == 0 || lisp_busy)
+		return false;
+
+	lisp_busy = true;
+	bool ok = lispTransfer(code, size, restart, canId);
+	lisp_busy = false;
+	return ok;
+}
+
+bool VescUart::lispTransfer(Stream *code, uint32_t size, uint8_t restart, uint8_t canId)
+{
+	uint8_t (*window)[VESC_LISP_CHUNK] = lisp_window;
+	uint16_t windowLen[VESC_LISP_WINDOW];
+	uint8_t oldest = 0;
+	uint8_t inFlight = 0;
+	uint8_t retries = 0;
+	uint32_t acked = 0;
+	uint32_t sent = 0;
+
+	while (acked < size)
+	{
+		while (inFlight < VESC_LISP_WINDOW && sent < size)
+		{
+			uint8_t slot = (oldest + inFlight) % VESC_LISP_WINDOW;
+			uint16_t len = size - sent > VESC_LISP_CHUNK ? VESC_LISP_CHUNK : size - sent;
+
+			if (code->readBytes(window[slot], len) != len)
+			{
+				if (inFlight > 0)
+					drainUart();
+				return false;
+			}
+
+			windowLen[slot] = len;
+			lispStreamChunk(sent, size, restart, window[slot], len, canId);
+			sent += len;
+			inFlight++;
+		}
+
+		uint8_t message[256];
+		int messageLength = receiveUartMessage(message);
+		int32_t index = 1;
+		int32_t offset = -1;
+		int16_t result = -1;
+
+		if (messageLength >= 7 && message[0] == COMM_LISP_STREAM_CODE)
+		{
+			offset = buffer_get_int32(message, &index);
+			result = buffer_get_int16(message, &index);
+		}
+
+		if (offset == (int32_t)acked && result >= 0)
+		{
+			acked += windowLen[oldest];
+			oldest = (oldest + 1) % VESC_LISP_WINDOW;
+			inFlight--;
+			retries = 0;
+			continue;
+		}
+
+		if (++retries > VESC_LISP_RETRIES)
+		{
+			if (debugPort != NULL)
+				debugPort->printf("Stream code failed at %u, result %d\n", (unsigned)acked, result);
+			drainUart();
+			return false;
+		}
+
+		// Flow control: give LispBM time to consume, then send the window again
+		// from the oldest chunk that was not taken.
+		drainUart();
+		uint32_t resend = acked;
+		for (uint8_t i = 0; i < inFlight; i++)
+		{
+			uint8_t slot = (oldest + i) % VESC_LISP_WINDOW;
+			lispStreamChunk(resend, size, restart, window[slot], windowLen[slot], canId);
+			resend += windowLen[slot];
+		}
+	}
+
+	return true;
+}
+
+void VescUart::lispReplCmd(const char *cmd, uint8_t canId)
+{
+	int32_t index = 0;
+	uint8_t payload[256];
+	size_t len = strlen(cmd);
+
+	if (len > sizeof(payload) - 4)
+		len = sizeof(payload) - 4;
+
+	if (canId != 0)
+	{
+		payload[index++] = {COMM_FORWARD_CAN};
+		payload[index++] = canId;
+	}
+	payload[index++] = {COMM_LISP_REPL_CMD};
+	memcpy(payload + index, cmd, len);
+	index += len;
+	payload[index++] = 0;
+	packSendPayload(payload, index);
+}
+
+void VescUart::setLispPrintStorage(char *storage, uint16_t size)
+{
+	line_ring_init(&lispPrint, storage, size);
+}
+
+int VescUart::lispReadPrint(char *line, uint16_t size)
+{
+	return line_ring_pop(&lispPrint, line, size);
+}
+
+uint16_t VescUart::get_lisp_print_lines(void)
+{
+	return line_ring_lines(&lispPrint);
+}
+
+uint32_t VescUart::get_lisp_print_dropped(void)
+{
+	return lispPrint.dropped;
+}
+
+void VescUart::lispDecodeStats(const uint8_t *message, int lenPay)
+{
+	int32_t index = 1;
+
+	lispStats.cpu_use = buffer_get_float16(message, 1e2, &index);
+	lispStats.heap_use = buffer_get_float16(message, 1e2, &index);
+	lispStats.mem_use = buffer_get_float16(message, 1e2, &index);
+	lispStats.stack_use = buffer_get_float16(message, 1e2, &index);
+
+	// Strings are 0 terminated, copy what fits
+	const char *text = (const char *)message + index;
+	size_t len = strnlen(text, lenPay - index);
+	size_t copy = len < sizeof(lispStats.done_ctx_r) ? len : sizeof(lispStats.done_ctx_r) - 1;
+	memcpy(lispStats.done_ctx_r, text, copy);
+	lispStats.done_ctx_r[copy] = 0;
+	index += len + 1;
+
+	lispStats.bindingNum = 0;
+	while (index < lenPay && lispStats.bindingNum < VESC_LISP_MAX_BINDINGS)
+	{
+		text = (const char *)message + index;
+		len = strnlen(text, lenPay - index);
+		if (index + (int32_t)len + 1 + 4 > lenPay)
+			break;
+
+		uint8_t b = lispStats.bindingNum++;
+		copy = len < sizeof(lispStats.bindingName[b]) ? len : sizeof(lispStats.bindingName[b]) - 1;
+		memcpy(lispStats.bindingName[b], text, copy);
+		lispStats.bindingName[b][copy] = 0;
+		index += len + 1;
+		lispStats.bindingValue[b] = buffer_get_float32_auto(message, &index);
+	}
+}
+
+bool VescUart::lispStatsUpdate(uint32_t interval_ms, uint8_t canId)
+{
+	if (lispStatsPolled && millis() - lispStatsTime < interval_ms)
+		return false;
+
+	lispStatsTime = millis();
+	lispStatsPolled = true;
+
+	int32_t index = 0;
+	uint8_t payload[3];
+
+	if (canId != 0)
+	{
+		payload[index++] = {COMM_FORWARD_CAN};
+		payload[index++] = canId;
+	}
+	payload[index++] = {COMM_LISP_GET_STATS};
+	packSendPayload(payload, index);
+
+	uint8_t message[256];
+	int messageLength = receiveUartMessage(message);
+
+	if (messageLength < 10 || message[0] != COMM_LISP_GET_STATS)
+		return false;
+
+	lispDecodeStats(message, messageLength);
+
+	if (debugPort != NULL)
+		debugPort->printf("Lisp cpu %.1f heap %.1f mem %.1f\n", lispStats.cpu_use, lispStats.heap_use, lispStats.mem_use);
+
+	return true;
+}
+
+const VescUart::lispStats_t &VescUart::get_lisp_stats(void)
+{
+	return lispStats;
+}
@@ -0,0 +1,239 @@
+#include <stdint.h>
+#include "VescUart.h"
+
+/**
+ * Log rows pushed by the VESC (LispBM log-start / log-config-field / log-send-f32 /
+ * log-send-f64), the same packets VESC Express records to its SD card:
+ *
+ *   COMM_LOG_START         field_num (int32), rate_hz, append_time, append_gnss...
+ *   COMM_LOG_CONFIG_FIELD  field (int32), key, name, unit (0 terminated), precision,
+ *                          is_relative, is_timestamp
+ *   COMM_LOG_DATA_F32      first field (int32), float32_auto values
+ *   COMM_LOG_DATA_F64      first field (int32), float64_auto values (value + error as
+ *                          two float32_auto)
+ *
+ * Rows are stored column wise: field f of slot i is logStorage[f * logCapacity + i].
+ * A row may be sent in several packets; it is committed when its last field arrives.
+ */
+
+void VescUart::setLogStorage(float *storage, uint16_t size)
+{
+	logStorage = storage;
+	logStorageSize = size;
+	logCapacity = (logFieldNum > 0 && storage != NULL) ? size / logFieldNum : 0;
+	if (logCapacity < 2)
+		logCapacity = 0;
+	logHead = 0;
+	logRows = 0;
+	logUnflushed = 0;
+}
+
+void VescUart::logStart(uint8_t *message, int lenPay)
+{
+	if (lenPay < 5)
+		return;
+
+	int32_t index = 1;
+	int32_t fieldNum = buffer_get_int32(message, &index);
+
+	if (fieldNum < 0)
+		fieldNum = 0;
+	if (fieldNum > VESC_LOG_MAX_FIELDS)
+	{
+		if (debugPort != NULL)
+			debugPort->printf("Log has %d fields, keeping %d\n", (int)fieldNum, VESC_LOG_MAX_FIELDS);
+		fieldNum = VESC_LOG_MAX_FIELDS;
+	}
+
+	logFieldNum = fieldNum;
+	memset(logFields, 0, sizeof(logFields));
+	logRunning = true;
+	logOverruns = 0;
+	logHeaderWritten = false;
+	setLogStorage(logStorage, logStorageSize);
+}
+
+void VescUart::logConfigField(uint8_t *message, int lenPay)
+{
+	if (lenPay < 5)
+		return;
+
+	int32_t index = 1;
+	int32_t field = buffer_get_int32(message, &index);
+
+	if (field < 0 || field >= logFieldNum)
+		return;
+
+	// Skip the key, keep the name, skip the unit
+	const char *strings[3];
+	for (uint8_t i = 0; i < 3; i++)
+	{
+		strings[i] = (const char *)message + index;
+		while (index < lenPay && message[index] != 0)
+			index++;
+		if (index >= lenPay)
+			return;
+		index++;
+	}
+
+	if (index + 3 > lenPay)
+		return;
+
+	logField_t *f = &logFields[field];
+	strncpy(f->name, strings[1], sizeof(f->name) - 1);
+	f->name[sizeof(f->name) - 1] = 0;
+	f->precision = message[index++];
+	f->isRelative = message[index++];
+	f->isTimestamp = message[index++];
+}
+
+void VescUart::logData(uint8_t *message, int lenPay, bool f64)
+{
+	if (!logRunning || logCapacity == 0 || lenPay < 5)
+		return;
+
+	int32_t index = 1;
+	int32_t field = buffer_get_int32(message, &index);
+	uint8_t size = f64 ? 8 : 4;
+
+	if (field < 0)
+		return;
+
+	while (index + size <= lenPay && field < logFieldNum)
+	{
+		float value = buffer_get_float32_auto(message, &index);
+		if (f64)
+			value += buffer_get_float32_auto(message, &index);
+
+		logStorage[field * logCapacity + logHead] = value;
+		field++;
+	}
+
+	if (field < logFieldNum)
+		return;
+
+	// Row complete. The slot at logHead is always the one being filled, so at
+	// most logCapacity - 1 rows are complete.
+	logHead = (logHead + 1) % logCapacity;
+	if (logRows < logCapacity - 1)
+		logRows++;
+
+	if (logUnflushed < logCapacity - 1)
+		logUnflushed++;
+	else
+		logOverruns++;
+}
+
+bool VescUart::is_log_running(void)
+{
+	return logRunning;
+}
+
+uint8_t VescUart::get_log_field_count(void)
+{
+	return logFieldNum;
+}
+
+const VescUart::logField_t *VescUart::get_log_field(uint8_t field)
+{
+	return field < logFieldNum ? &logFields[field] : NULL;
+}
+
+uint16_t VescUart::get_log_rows(void)
+{
+	return logRows;
+}
+
+uint16_t VescUart::get_log_capacity(void)
+{
+	return logCapacity > 0 ? logCapacity - 1 : 0;
+}
+
+uint32_t VescUart::get_log_overruns(void)
+{
+	return logOverruns;
+}
+
+float VescUart::get_log_value(uint8_t field, uint16_t age)
+{
+	if (field >= logFieldNum || age >= logRows)
+		return NAN;
+
+	uint16_t slot = (logHead + logCapacity - 1 - age) % logCapacity;
+	return logStorage[field * logCapacity + slot];
+}
+
+bool VescUart::logWindow(uint8_t field, uint16_t rows, float *min, float *max, float *mean)
+{
+	if (field >= logFieldNum || logRows == 0)
+		return false;
+
+	if (rows > logRows || rows == 0)
+		rows = logRows;
+
+	const float *column = logStorage + field * logCapacity;
+	uint16_t slot = (logHead + logCapacity - rows) % logCapacity;
+	float lo = column[slot];
+	float hi = column[slot];
+	float sum = 0.0;
+
+	for (uint16_t i = 0; i < rows; i++)
+	{
+		float v = column[slot];
+		if (v < lo)
+			lo = v;
+		if (v > hi)
+			hi = v;
+		sum += v;
+
+		if (++slot == logCapacity)
+			slot = 0;
+	}
+
+	if (min != NULL)
+		*min = lo;
+	if (max != NULL)
+		*max = hi;
+	if (mean != NULL)
+		*mean = sum / rows;
+
+	return true;
+}
+
+uint16_t VescUart::logFlush(Print *out)
+{
+	if (out == NULL || logFieldNum == 0)
+		return 0;
+
+	uint8_t buffer[VESC_LOG_MAX_FIELDS * 4];
+	int32_t index = 0;
+
+	if (!logHeaderWritten)
+	{
+		out->write((const uint8_t *)"VLOG", 4);
+		out->write(logFieldNum);
+		for (uint8_t f = 0; f < logFieldNum; f++)
+			out->write((const uint8_t *)logFields[f].name, strlen(logFields[f].name) + 1);
+		logHeaderWritten = true;
+	}
+
+	uint16_t written = 0;
+	if (logCapacity == 0)
+		return 0;
+
+	uint16_t slot = (logHead + logCapacity - logUnflushed) % logCapacity;
+
+	while (logUnflushed > 0)
+	{
+		index = 0;
+		for (uint8_t f = 0; f < logFieldNum; f++)
+			buffer_append_float32_auto(buffer, logStorage[f * logCapacity + slot], &index);
+		out->write(buffer, index);
+
+		slot = (slot + 1) % logCapacity;
+		logUnflushed--;
+		written++;
+	}
+
+	return written;
+}
@@ -0,0 +1,186 @@
+#include <stdint.h>
+#include "VescReplay.h"
+
+bool VescReplay::begin(Stream *log, bool realtime)
+{
+	this->log = log;
+	this->realtime = realtime;
+	ended = true;
+	recordTime = 0;
+	remaining = 0;
+	peeked = -1;
+	rxBytes = 0;
+	txBytes = 0;
+	txExpected = 0;
+	txTime = 0;
+
+	uint8_t header[VESC_CAPTURE_HEADER];
+	for (uint8_t i = 0; i < sizeof(header); i++)
+	{
+		int c = logByte();
+		if (c < 0)
+			return false;
+		header[i] = c;
+	}
+
+	if (memcmp(header, "VCAP", 4) != 0 || header[4] != VESC_CAPTURE_VERSION)
+		return false;
+
+	ended = false;
+	txWritten = micros();
+	return true;
+}
+
+bool VescReplay::done(void)
+{
+	return !nextRx();
+}
+
+uint32_t VescReplay::get_rx_bytes(void)
+{
+	return rxBytes;
+}
+
+uint32_t VescReplay::get_tx_bytes(void)
+{
+	return txBytes;
+}
+
+int VescReplay::logByte(void)
+{
+	if (log == NULL || log->available() <= 0)
+		return -1;
+	return log->read();
+}
+
+bool VescReplay::logVarint(uint32_t *value)
+{
+	*value = 0;
+	for (uint8_t shift = 0; shift < 35; shift += 7)
+	{
+		int c = logByte();
+		if (c < 0)
+			return false;
+		*value |= (uint32_t)(c & 0x7F) << shift;
+		if (!(c & 0x80))
+			return true;
+	}
+	return false;
+}
+
+bool VescReplay::nextRx(void)
+{
+	// Skip to the next received chunk, noting how much was sent before it
+	while (!ended && remaining == 0)
+	{
+		int direction = logByte();
+		uint32_t delta, len;
+
+		if (direction < 0 || !logVarint(&delta) || !logVarint(&len))
+		{
+			ended = true;
+			break;
+		}
+
+		recordTime += delta;
+
+		if (direction == VESC_CAPTURE_RX)
+		{
+			remaining = len;
+			continue;
+		}
+
+		txExpected += len;
+		txTime = recordTime;
+		if ((int32_t)(txBytes - txExpected) >= 0)
+			txWritten = lastWrite; // VescUart got there before the log was read
+
+		for (uint32_t i = 0; i < len; i++)
+		{
+			if (logByte() < 0)
+			{
+				ended = true;
+				break;
+			}
+		}
+	}
+
+	return remaining > 0;
+}
+
+int VescReplay::available(void)
+{
+	int held = peeked >= 0 ? 1 : 0;
+
+	if (!nextRx())
+		return held;
+
+	// Not before the request it answered has been written
+	if ((int32_t)(txBytes - txExpected) < 0)
+		return held;
+
+	if (realtime && (int32_t)(micros() - txWritten - (recordTime - txTime)) < 0)
+		return held;
+
+	int waiting = log->available();
+	return held + ((uint32_t)waiting < remaining ? waiting : remaining);
+}
+
+int VescReplay::read(void)
+{
+	if (peeked >= 0)
+	{
+		int c = peeked;
+		peeked = -1;
+		return c;
+	}
+
+	if (available() <= 0)
+		return -1;
+
+	int c = logByte();
+	if (c < 0)
+	{
+		ended = true;
+		remaining = 0;
+		return -1;
+	}
+
+	remaining--;
+	rxBytes++;
+	return c;
+}
+
+int VescReplay::peek(void)
+{
+	if (peeked < 0)
+		peeked = read();
+	return peeked;
+}
+
+size_t VescReplay::write(uint8_t c)
+{
+	(void)c;
+	written(1);
+	return 1;
+}
+
+size_t VescReplay::write(const uint8_t *buffer, size_t size)
+{
+	(void)buffer;
+	written(size);
+	return size;
+}
+
+void VescReplay::written(size_t len)
+{
+	// Read up to the TX record this write belongs to, so the time it caught up
+	// with the capture is known
+	nextRx();
+
+	bool behind = (int32_t)(txBytes - txExpected) < 0;
+	txBytes += len;
+	lastWrite = micros();
+	if (behind && (int32_t)(txBytes - txExpected) >= 0)
+		txWritten = lastWrite;
+}
@@ -0,0 +1,82 @@
+#ifndef _VESCREPLAY_h
+#define _VESCREPLAY_h
+
+#include <Arduino.h>
+
+/**
+ * Capture log written by VescUart::setCapture():
+ *
+ *   header  "VCAP", version (uint8), micros() at the start (uint32)
+ *   record  direction (uint8, VESC_CAPTURE_RX / VESC_CAPTURE_TX)
+ *           us since the previous record (LEB128)
+ *           length (LEB128), then the bytes of the chunk
+ *
+ * Multi-byte header fields are big endian like the VESC protocol.
+ */
+#define VESC_CAPTURE_VERSION 1
+#define VESC_CAPTURE_HEADER 9
+#define VESC_CAPTURE_RX 0
+#define VESC_CAPTURE_TX 1
+
+/**
+ * Stream that plays the received side of a capture back to VescUart:
+ *
+ *   VescReplay replay;
+ *   replay.begin(&logFile, true);
+ *   UART.setSerialPort(&replay);
+ *
+ * A received chunk that followed a sent one in the capture is held back until
+ * VescUart has written as many bytes as the capture sent up to there, so
+ * replies come after their requests even at full speed. In real time it then
+ * becomes readable at its recorded offset from that write (from begin() when
+ * nothing was sent before it), reproducing the timing of the session;
+ * otherwise at once, which measures the parser on real traffic. What VescUart
+ * writes is only counted.
+ */
+class VescReplay : public Stream
+{
+public:
+  /**
+   * @brief      Start playing a capture
+   * @param      log       - The capture, read sequentially
+   * @param      realtime  - Keep the recorded timing
+   * @return     False if log does not start with a capture header
+   */
+  bool begin(Stream *log, bool realtime = true);
+
+  /** True when every received chunk has been read */
+  bool done(void);
+
+  /** Bytes played back and bytes VescUart wrote so far */
+  uint32_t get_rx_bytes(void);
+  uint32_t get_tx_bytes(void);
+
+  int available(void) override;
+  int read(void) override;
+  int peek(void) override;
+  size_t write(uint8_t c) override;
+  size_t write(const uint8_t *buffer, size_t size) override;
+
+  using Print::write;
+
+private:
+  Stream *log = NULL;
+  bool realtime = true;
+  bool ended = true;
+  uint32_t recordTime = 0;  // offset of the current record from the capture start
+  uint32_t remaining = 0;   // bytes of the current RX record not read yet
+  int peeked = -1;
+  uint32_t rxBytes = 0;
+  uint32_t txBytes = 0;
+  uint32_t txExpected = 0;  // TX bytes in the capture up to the current record
+  uint32_t txTime = 0;      // offset of the last TX record from the capture start
+  uint32_t txWritten = 0;   // micros() when txBytes reached txExpected, begin() at first
+  uint32_t lastWrite = 0;   // micros() of the last write
+
+  int logByte(void);
+  bool logVarint(uint32_t *value);
+  bool nextRx(void);
+  void written(size_t len);
+};
+
+#endif
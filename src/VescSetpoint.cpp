@@ -0,0 +1,168 @@
+#include <stdint.h>
+#include "VescUart.h"
+
+/**
+ * Setpoint commands, none of them is answered:
+ *
+ *   COMM_SET_CURRENT        current (int32, A * 1000)
+ *   COMM_SET_CURRENT_BRAKE  current (int32, A * 1000)
+ *   COMM_SET_DUTY           duty (int32, * 100000)
+ *   COMM_SET_RPM            erpm (int32)
+ *   COMM_SET_CURRENT_REL    relative current (float32, * 1e5)
+ *   COMM_ALIVE              resets the VESC timeout
+ *
+ * A slot is sent at most every VESC_SETPOINT_INTERVAL ms. A value set in
+ * between waits in the slot and is overwritten by newer ones; it goes out from
+ * poll() once the interval is over, or earlier when another request is sent,
+ * because packSendPayload() flushes pending setpoints first.
+ *
+ * Each command is a control mode and the VESC follows the last one received,
+ * so setting one drops what other slots still hold for the same controller.
+ * Otherwise a brake current set before a current could go out after it.
+ */
+
+static const COMM_PACKET_ID setpointPackets[] = {
+	COMM_SET_CURRENT,
+	COMM_SET_CURRENT_BRAKE,
+	COMM_SET_DUTY,
+	COMM_SET_RPM,
+	COMM_SET_CURRENT_REL,
+};
+
+void VescUart::setCurrent(float current, uint8_t canId)
+{
+	setpointSet(SETPOINT_CURRENT, current, canId);
+}
+
+void VescUart::setBrakeCurrent(float current, uint8_t canId)
+{
+	setpointSet(SETPOINT_CURRENT_BRAKE, current, canId);
+}
+
+void VescUart::setDuty(float duty, uint8_t canId)
+{
+	setpointSet(SETPOINT_DUTY, duty, canId);
+}
+
+void VescUart::setRpm(float rpm, uint8_t canId)
+{
+	setpointSet(SETPOINT_RPM, rpm, canId);
+}
+
+void VescUart::setCurrentRel(float current, uint8_t canId)
+{
+	setpointSet(SETPOINT_CURRENT_REL, current, canId);
+}
+
+void VescUart::releaseSetpoints(void)
+{
+	for (uint8_t i = 0; i < SETPOINT_COUNT; i++)
+		setpoints[i].pending = false;
+	setpointPending = 0;
+	aliveActive = false;
+}
+
+void VescUart::setpointSet(uint8_t slot, float value, uint8_t canId)
+{
+	setpoint_t *sp = &setpoints[slot];
+
+	// A pending value for another controller must not be lost
+	if (sp->pending && sp->canId != canId)
+		setpointSend(slot);
+
+	// The new control mode replaces older ones not sent yet
+	for (uint8_t i = 0; i < SETPOINT_COUNT; i++)
+	{
+		if (i != slot && setpoints[i].pending && setpoints[i].canId == canId)
+		{
+			setpoints[i].pending = false;
+			setpointPending &= ~(1 << i);
+		}
+	}
+
+	sp->value = value;
+	sp->canId = canId;
+	sp->pending = true;
+	setpointPending |= 1 << slot;
+
+	aliveActive = true;
+	aliveCanId = canId;
+
+	if (millis() - sp->lastSent >= VESC_SETPOINT_INTERVAL)
+		setpointSend(slot);
+}
+
+void VescUart::setpointSend(uint8_t slot)
+{
+	setpoint_t *sp = &setpoints[slot];
+	int32_t index = 0;
+	uint8_t payload[7];
+
+	if (sp->canId != 0)
+	{
+		payload[index++] = {COMM_FORWARD_CAN};
+		payload[index++] = sp->canId;
+	}
+	payload[index++] = setpointPackets[slot];
+
+	switch (slot)
+	{
+	case SETPOINT_CURRENT:
+	case SETPOINT_CURRENT_BRAKE:
+		buffer_append_int32(payload, (int32_t)(sp->value * 1000), &index);
+		break;
+
+	case SETPOINT_DUTY:
+		buffer_append_int32(payload, (int32_t)(sp->value * 100000), &index);
+		break;
+
+	case SETPOINT_RPM:
+		buffer_append_int32(payload, (int32_t)sp->value, &index);
+		break;
+
+	case SETPOINT_CURRENT_REL:
+		buffer_append_float32(payload, sp->value, 1e5, &index);
+		break;
+	}
+
+	sp->pending = false;
+	setpointPending &= ~(1 << slot);
+
+	setpointSending = true;
+	packSendPayload(payload, index);
+	setpointSending = false;
+
+	sp->lastSent = millis();
+	if (sp->canId == aliveCanId)
+		aliveLast = sp->lastSent;
+}
+
+void VescUart::setpointService(bool all)
+{
+	uint32_t now = millis();
+
+	for (uint8_t i = 0; i < SETPOINT_COUNT && setpointPending != 0; i++)
+	{
+		if (setpoints[i].pending && (all || now - setpoints[i].lastSent >= VESC_SETPOINT_INTERVAL))
+			setpointSend(i);
+	}
+
+	if (all || !aliveActive || now - aliveLast < VESC_ALIVE_INTERVAL)
+		return;
+
+	int32_t index = 0;
+	uint8_t payload[3];
+
+	if (aliveCanId != 0)
+	{
+		payload[index++] = {COMM_FORWARD_CAN};
+		payload[index++] = aliveCanId;
+	}
+	payload[index++] = {COMM_ALIVE};
+
+	setpointSending = true;
+	packSendPayload(payload, index);
+	setpointSending = false;
+
+	aliveLast = now;
+}
@@ -0,0 +1,130 @@
+#include <stdint.h>
+#include "VescUart.h"
+
+/**
+ * Terminal commands:
+ *
+ *   COMM_TERMINAL_CMD       command line, output comes back as COMM_PRINT frames
+ *   COMM_TERMINAL_CMD_SYNC  command line, COMM_PRINT frames followed by a
+ *                           COMM_TERMINAL_CMD_SYNC reply once the command ran
+ *
+ * Nothing here waits for the VESC: commands are queued and sent from poll(),
+ * COMM_PRINT frames are picked up by poll() or while another request waits for
+ * its reply, so telemetry keeps its rate while long outputs stream in. A plain
+ * COMM_TERMINAL_CMD has no end marker, it is done once the VESC stays quiet for
+ * VESC_TERMINAL_IDLE ms.
+ */
+
+bool VescUart::terminalCmd(const char *cmd, terminalDone_t done, void *context, bool sync, uint8_t canId)
+{
+	if (terminalCount >= VESC_TERMINAL_QUEUE)
+		return false;
+
+	terminalCmd_t *entry = &terminalQueue[(terminalHead + terminalCount) % VESC_TERMINAL_QUEUE];
+	strncpy(entry->cmd, cmd, sizeof(entry->cmd) - 1);
+	entry->cmd[sizeof(entry->cmd) - 1] = 0;
+	entry->done = done;
+	entry->context = context;
+	entry->sync = sync;
+	entry->canId = canId;
+	terminalCount++;
+
+	terminalService();
+	return true;
+}
+
+void VescUart::setTerminalStorage(char *storage, uint16_t size)
+{
+	line_ring_init(&terminalPrint, storage, size);
+}
+
+int VescUart::terminalReadLine(char *line, uint16_t size)
+{
+	return line_ring_pop(&terminalPrint, line, size);
+}
+
+uint16_t VescUart::get_terminal_print_lines(void)
+{
+	return line_ring_lines(&terminalPrint);
+}
+
+bool VescUart::is_terminal_busy(void)
+{
+	return terminalCount > 0;
+}
+
+uint32_t VescUart::get_terminal_dropped(void)
+{
+	return terminalPrint.dropped;
+}
+
+void VescUart::terminalCapture(const uint8_t *text, int len)
+{
+	// One COMM_PRINT may hold several lines, keep them apart in the ring
+	int start = 0;
+
+	for (int i = 0; i <= len; i++)
+	{
+		if (i == len || text[i] == '\n' || text[i] == 0)
+		{
+			if (i > start)
+			{
+				line_ring_push(&terminalPrint, (const char *)text + start, i - start);
+				terminalLines++;
+			}
+			if (i < len && text[i] == 0)
+				break;
+			start = i + 1;
+		}
+	}
+
+	terminalLastPrint = millis();
+}
+
+void VescUart::terminalService(void)
+{
+	if (terminalRunning)
+	{
+		terminalCmd_t *entry = &terminalQueue[terminalHead];
+		uint32_t now = millis();
+		bool timedOut = now - terminalStart >= VESC_TERMINAL_TIMEOUT;
+		bool quiet = !entry->sync && now - terminalLastPrint >= VESC_TERMINAL_IDLE;
+
+		if (!terminalSyncDone && !quiet && !timedOut)
+			return;
+
+		// Take the entry off the queue first, the callback may queue the next command
+		terminalCmd_t finished = *entry;
+		terminalRunning = false;
+		terminalHead = (terminalHead + 1) % VESC_TERMINAL_QUEUE;
+		terminalCount--;
+
+		if (finished.done != NULL)
+			finished.done(finished.context, finished.cmd, terminalLines, timedOut && !terminalSyncDone && !quiet);
+	}
+
+	if (terminalRunning || terminalCount == 0)
+		return;
+
+	terminalCmd_t *entry = &terminalQueue[terminalHead];
+	int32_t index = 0;
+	uint8_t payload[VESC_TERMINAL_CMD_LEN + 3];
+
+	if (entry->canId != 0)
+	{
+		payload[index++] = {COMM_FORWARD_CAN};
+		payload[index++] = entry->canId;
+	}
+	payload[index++] = entry->sync ? COMM_TERMINAL_CMD_SYNC : COMM_TERMINAL_CMD;
+
+	size_t len = strlen(entry->cmd);
+	memcpy(payload + index, entry->cmd, len);
+	index += len;
+	packSendPayload(payload, index);
+
+	terminalRunning = true;
+	terminalSyncDone = false;
+	terminalLines = 0;
+	terminalStart = millis();
+	terminalLastPrint = terminalStart;
+}
@@ -3,6 +3,8 @@
 
 VescUart::VescUart(uint32_t timeout_ms ) : _TIMEOUT(timeout_ms) 
 {
+	line_ring_init(&lispPrint, NULL, 0);
+	line_ring_init(&terminalPrint, NULL, 0);
 }
 
 void VescUart::setSerialPort(Stream *port)
@@ -16,6 +18,82 @@ void VescUart::setDebugPort(Stream *port)
 }
 
 int VescUart::receiveUartMessage(uint8_t *payloadReceived)
+{
+	// Frames the VESC sends on its own may arrive before the reply, handle
+	// them and keep waiting as long as the timeout allows.
+	uint32_t start = millis();
+
+	for (;;)
+	{
+		int lenPayload = receiveUartFrame(payloadReceived);
+
+		if (lenPayload <= 0 || !handleUnsolicited(payloadReceived, lenPayload))
+			return lenPayload;
+
+		if (millis() - start >= _TIMEOUT)
+			return 0;
+	}
+}
+
+void VescUart::poll(void)
+{
+	uint8_t message[256];
+
+	while (serialPort != NULL && serialPort->available())
+	{
+		int lenPayload = receiveUartFrame(message);
+
+		if (lenPayload > 0 && !handleUnsolicited(message, lenPayload) && debugPort != NULL)
+			debugPort->printf("Unexpected packet %d\n", message[0]);
+	}
+
+	terminalService();
+	setpointService(false);
+}
+
+bool VescUart::handleUnsolicited(uint8_t *message, int lenPay)
+{
+	switch (message[0])
+	{
+	case COMM_LOG_START:
+		logStart(message, lenPay);
+		return true;
+
+	case COMM_LOG_STOP:
+		logRunning = false;
+		return true;
+
+	case COMM_LOG_CONFIG_FIELD:
+		logConfigField(message, lenPay);
+		return true;
+
+	case COMM_LOG_DATA_F32:
+		logData(message, lenPay, false);
+		return true;
+
+	case COMM_LOG_DATA_F64:
+		logData(message, lenPay, true);
+		return true;
+
+	case COMM_LISP_PRINT:
+		line_ring_push(&lispPrint, (const char *)message + 1, lenPay - 1);
+		return true;
+
+	case COMM_PRINT:
+		terminalCapture(message + 1, lenPay - 1);
+		return true;
+
+	case COMM_TERMINAL_CMD_SYNC:
+		terminalCapture(message + 1, lenPay - 1);
+		terminalSyncDone = terminalRunning;
+		return true;
+
+	default:
+		return false;
+	}
+}
+
+int VescUart::receiveUartFrame(uint8_t *payloadReceived)
 {
 
 	// Messages <= 255 starts with "2", 2nd byte is length
@@ -28,61 +106,62 @@ int VescUart::receiveUartMessage(uint8_t *payloadReceived)
 	uint16_t counter = 0;
 	uint16_t endMessage = 256;
 	bool messageRead = false;
-	uint8_t messageReceived[256];
+	uint8_t messageReceived[255 + 5 + 1]; // largest payload, framing, terminator
 	uint16_t lenPayload = 0;
 
-	uint32_t timeout = millis() + _TIMEOUT; // Defining the timestamp for timeout (100ms before timeout)
+	uint32_t start = millis();
 
-	while (millis() < timeout && messageRead == false)
+	while (millis() - start < _TIMEOUT && messageRead == false)
 	{
-
-		while (serialPort->available())
+		int available = serialPort->available();
+		if (available <= 0)
+			continue;
+
+		// Read in blocks, but never past the end of this frame: the next one
+		// stays in the UART for the next call.
+		uint16_t want = (counter < 2 ? 2 : endMessage) - counter;
+		if (want > available)
+			want = available;
+		counter += uartRead(messageReceived + counter, want);
+
+		if (counter == 2)
 		{
 
-			messageReceived[counter++] = serialPort->read();
-
-			if (counter == 2)
+			switch (messageReceived[0])
 			{
+			case 2:
+				endMessage = messageReceived[1] + 5; // Payload size + 2 for sice + 3 for SRC and End.
+				lenPayload = messageReceived[1];
+				break;
 
-				switch (messageReceived[0])
+			case 3:
+				// Frames > 255 bytes are read with receiveUartStream()
+				if (debugPort != NULL)
 				{
-				case 2:
-					endMessage = messageReceived[1] + 5; // Payload size + 2 for sice + 3 for SRC and End.
-					lenPayload = messageReceived[1];
-					break;
-
-				case 3:
-					// ToDo: Add Message Handling > 255 (starting with 3)
-					if (debugPort != NULL)
-					{
-						debugPort->println("Message is larger than 256 bytes - not supported");
-					}
-					break;
+					debugPort->println("Message is larger than 256 bytes - not supported");
+				}
+				return 0;
 
-				default:
-					if (debugPort != NULL)
-					{
-						debugPort->println("Unvalid start bit");
-					}
-					break;
+			default:
+				if (debugPort != NULL)
+				{
+					debugPort->println("Unvalid start bit");
 				}
+				return 0;
 			}
+		}
 
-			if (counter >= sizeof(messageReceived))
-			{
-				break;
-			}
+		if (counter == endMessage)
+		{
+			if (messageReceived[endMessage - 1] != 3)
+				return 0;
 
-			if (counter == endMessage && messageReceived[endMessage - 1] == 3)
+			messageReceived[endMessage] = 0;
+			if (debugPort != NULL)
 			{
-				messageReceived[endMessage] = 0;
-				if (debugPort != NULL)
-				{
-					debugPort->println("End of message reached!");
-				}
-				messageRead = true;
-				break; // Exit if end of message is reached, even if there is still more data in the buffer.
+				debugPort->println("End of message reached!");
 			}
+			messageRead = true;
 		}
 	}
 	
@@ -163,181 +242,455 @@ bool VescUart::unpackPayload(uint8_t *message, int lenMes, uint8_t *payload)
 	}
 }
 
+int VescUart::receiveUartStream(uint8_t packetId, payloadSink_t sink, void *context)
+{
+	// Same framing as receiveUartMessage(), but the payload is never stored as a
+	// whole: it goes to sink in small chunks and the CRC is accumulated as we go.
+	// Frames of another packet id are not the reply. They are collected and
+	// handled like in receiveUartMessage(), then the next frame is awaited.
+
+	if (serialPort == NULL)
+		return -1;
+
+	uint8_t header[3];
+	uint8_t headerLen = 0;
+	uint8_t headerSize = 0;
+	uint16_t lenPayload = 0;
+	uint16_t received = 0;
+	uint8_t chunk[32];
+	uint8_t chunkLen = 0;
+	uint8_t trailer[3];
+	uint8_t trailerLen = 0;
+	uint16_t crcPayload = 0;
+	bool other = false;
+	uint8_t message[256];
+
+	uint32_t start = millis();
+
+	while (millis() - start < _TIMEOUT)
+	{
+		int available = serialPort->available();
+		if (available <= 0)
+			continue;
+
+		// Bytes left in this frame, so nothing of the next frame is consumed
+		uint16_t remaining;
+		if (headerSize == 0)
+			remaining = 1;
+		else if (headerLen < headerSize)
+			remaining = headerSize - headerLen;
+		else
+			remaining = lenPayload - received + sizeof(trailer) - trailerLen;
+
+		uint8_t block[32];
+		uint16_t want = remaining < sizeof(block) ? remaining : sizeof(block);
+		if (want > available)
+			want = available;
+		want = uartRead(block, want);
+
+		for (uint16_t i = 0; i < want; i++)
+		{
+			uint8_t c = block[i];
+
+			if (headerSize == 0 || headerLen < headerSize)
+			{
+				header[headerLen++] = c;
+
+				if (headerLen == 1)
+				{
+					if (c == 2)
+						headerSize = 2;
+					else if (c == 3)
+						headerSize = 3;
+					else
+					{
+						if (debugPort != NULL)
+							debugPort->println("Unvalid start bit");
+						return 0;
+					}
+				}
+				else if (headerLen == headerSize)
+				{
+					lenPayload = (headerSize == 2) ? header[1] : (uint16_t)(header[1] << 8 | header[2]);
+				}
+				continue;
+			}
+
+			if (received < lenPayload)
+			{
+				if (received == 0)
+					other = c != packetId;
+				if (other && received < sizeof(message))
+					message[received] = c;
+
+				chunk[chunkLen++] = c;
+				received++;
+
+				if (chunkLen == sizeof(chunk) || received == lenPayload)
+				{
+					crcPayload = crc16_continue(crcPayload, chunk, chunkLen);
+					if (!other)
+						sink(context, chunk, chunkLen);
+					chunkLen = 0;
+				}
+				continue;
+			}
+
+			trailer[trailerLen++] = c;
+
+			if (trailerLen == 3)
+			{
+				uint16_t crcMessage = (uint16_t)(trailer[0] << 8 | trailer[1]);
+				bool valid = trailer[2] == 3 && crcMessage == crcPayload;
+
+				if (debugPort != NULL)
+					debugPort->printf("Stream received %d bytes, SRC received: %d calc: %d\n", lenPayload, crcMessage, crcPayload);
+
+				if (!other)
+					return valid ? lenPayload : 0;
+
+				if (valid && lenPayload <= sizeof(message) && !handleUnsolicited(message, lenPayload) && debugPort != NULL)
+					debugPort->printf("Unexpected packet %d\n", message[0]);
+
+				headerSize = 0;
+				headerLen = 0;
+				received = 0;
+				trailerLen = 0;
+				crcPayload = 0;
+			}
+		}
+	}
+
+	if (debugPort != NULL)
+		debugPort->println("Timeout");
+
+	return 0;
+}
+
 int VescUart::packSendPayload(uint8_t *payload, int lenPay)
 {
+	return packSendPayload(NULL, 0, payload, lenPay);
+}
+
+int VescUart::packSendPayload(uint8_t *head, int lenHead, uint8_t *payload, int lenPay)
+{
+	// Setpoints waiting in their slot go out ahead of this frame
+	if (setpointPending != 0 && !setpointSending)
+		setpointService(true);
 
-	uint16_t crcPayload = crc16(payload, lenPay);
+	uint16_t crcPayload = crc16_continue(crc16(head, lenHead), payload, lenPay);
+	int lenFrame = lenHead + lenPay;
 	int count = 0;
-	uint8_t messageSend[256];
+	uint8_t header[3];
+	uint8_t trailer[3];
 
-	if (lenPay <= 256)
+	// Header, payload and trailer are written separately so the payload is
+	// never copied and may be longer than 256 bytes.
+	if (lenFrame <= 255)
 	{
-		messageSend[count++] = 2;
-		messageSend[count++] = lenPay;
+		header[count++] = 2;
+		header[count++] = lenFrame;
 	}
 	else
 	{
-		messageSend[count++] = 3;
-		messageSend[count++] = (uint8_t)(lenPay >> 8);
-		messageSend[count++] = (uint8_t)(lenPay & 0xFF);
+		header[count++] = 3;
+		header[count++] = (uint8_t)(lenFrame >> 8);
+		header[count++] = (uint8_t)(lenFrame & 0xFF);
 	}
 
-	memcpy(messageSend + count, payload, lenPay);
-	count += lenPay;
-
-	messageSend[count++] = (uint8_t)(crcPayload >> 8);
-	messageSend[count++] = (uint8_t)(crcPayload & 0xFF);
-	messageSend[count++] = 3;
-	// messageSend[count] = NULL;
+	trailer[0] = (uint8_t)(crcPayload >> 8);
+	trailer[1] = (uint8_t)(crcPayload & 0xFF);
+	trailer[2] = 3;
 
 	if (debugPort != NULL)
 	{
 		debugPort->print("Package to send: ");
-		serialPrint(messageSend, count);
+		serialPrint(header, count - 1);
+		if (lenHead > 0)
+			serialPrint(head, lenHead - 1);
+		serialPrint(payload, lenPay - 1);
+		serialPrint(trailer, 2);
 	}
 
 	// Sending package
 	if (serialPort != NULL)
-		serialPort->write(messageSend, count);
+	{
+		uartWrite(header, count);
+		if (lenHead > 0)
+			uartWrite(head, lenHead);
+		uartWrite(payload, lenPay);
+		uartWrite(trailer, sizeof(trailer));
+	}
 
 	// Returns number of send bytes
-	return count;
+	return count + lenFrame + sizeof(trailer);
 }
-bool VescUart::processReadPacket(uint8_t *message, int lenPay)
+
+void VescUart::copySink(void *context, const uint8_t *data, uint16_t len)
 {
+	copySink_t *sink = (copySink_t *)context;
 
-	COMM_PACKET_ID packetId;
-	int32_t index = 0;
-	packetId = (COMM_PACKET_ID)message[0];
+	for (uint16_t i = 0; i < len && sink->valid; i++, sink->pos++)
+	{
+		if (sink->pos < sink->expectLen)
+		{
+			sink->valid = (data[i] == sink->expect[sink->pos]);
+		}
+		else if (sink->pos - sink->expectLen < sink->size)
+		{
+			sink->dst[sink->pos - sink->expectLen] = data[i];
+		}
+		else
+		{
+			sink->valid = false; // does not fit
+		}
+	}
+}
+
+void VescUart::drainUart(void)
+{
+	if (serialPort == NULL)
+		return;
+
+	uint32_t start = millis();
+	uint8_t block[32];
+	int available;
+	while (millis() - start < _TIMEOUT)
+	{
+		while ((available = serialPort->available()) > 0)
+			uartRead(block, available < (int)sizeof(block) ? available : sizeof(block));
+	}
+}
+
+void VescUart::dropStale(void)
+{
+	// Replies carry no sequence number: a late or repeated reply in front of
+	// the request would be taken as its answer, a repeated one to the same
+	// command too. Only what is already here, nothing is waited for.
+	uint8_t message[256];
+
+	while (serialPort != NULL && serialPort->available() > 0)
+	{
+		int lenPayload = receiveUartFrame(message);
+
+		if (lenPayload > 0 && !handleUnsolicited(message, lenPayload) && debugPort != NULL)
+			debugPort->printf("Stale packet %d\n", message[0]);
+	}
+}
+
+// Float package commands, indexed by esp_commands. Reply lengths include the
+// packet id, magic number and command; a protocol 0 reply must lie within
+// minLen..maxLen, newer protocols may append fields.
+constexpr VescUart::espCommand_t VescUart::espCommands[] = {
+	{ESP_COMMAND_GET_READY, 4, 255, &VescUart::readyDecode}, // announces the protocol itself
+	{ESP_COMMAND_GET_ADV_INFO, 3 + advancedLayout::size, 3 + advancedLayout::size, &VescUart::advancedDecode},
+	{ESP_COMMAND_ENGINE_SOUND_INFO, 3 + soundLayout::size, 3 + soundLayout::size, &VescUart::soundDecode},
+	{ESP_COMMAND_SOUND_GET, 4, 4, &VescUart::soundTriggeredDecode},
+	{ESP_COMMAND_SOUND_SET, 0, 0, NULL}, // sent by the app, not by us
+	{ESP_COMMAND_ENABLE_ITEM_INFO, 4, 4, &VescUart::enableItemDecode},
+	{ESP_COMMAND_GET_BUNDLE, 3 + soundLayout::size + 2, 3 + soundLayout::size + 2, &VescUart::bundleDecode},
+	{ESP_COMMAND_ENGINE_SOUND_COMPACT, 11, 15, &VescUart::soundDecodeCompact},
+};
+
+bool VescUart::espRequest(esp_commands command)
+{
+	static_assert(sizeof(espCommands) / sizeof(espCommands[0]) == ESP_COMMAND_ENGINE_SOUND_COMPACT + 1,
+				  "every esp_commands value needs an entry");
+	static_assert(espCommands[ESP_COMMAND_ENGINE_SOUND_COMPACT].command == ESP_COMMAND_ENGINE_SOUND_COMPACT,
+				  "espCommands must be in esp_commands order");
+	static_assert(soundLayout::size == 17 && advancedLayout::size == 11,
+				  "float package reply layouts changed");
+
+	const espCommand_t *entry = &espCommands[command];
+	if (entry->decode == NULL)
+		return false;
+
+	dropStale();
+	espSend(command, 0);
+
+	uint8_t message[256];
+	int messageLength;
+	uint32_t start = millis();
+
+	// A reply to another command that was still on its way cannot be ours,
+	// keep reading for the rest of the timeout
+	do
+		messageLength = receiveUartMessage(message);
+	while (messageLength >= 3 && message[0] == COMM_CUSTOM_APP_DATA && message[1] == ESP32_COMMAND_ID &&
+		   message[2] != entry->command && millis() - start < _TIMEOUT);
 
 	if (debugPort != NULL)
+		debugPort->printf("message Length :%d\r\n", messageLength);
+
+	return espDecode(command, message, messageLength);
+}
+
+void VescUart::espSend(esp_commands command, uint8_t canId)
+{
+	int32_t index = 0;
+	uint8_t payload[5];
+
+	if (canId != 0)
+	{
+		payload[index++] = {COMM_FORWARD_CAN};
+		payload[index++] = canId;
+	}
+	payload[index++] = {COMM_CUSTOM_APP_DATA};
+	payload[index++] = ESP32_COMMAND_ID;
+	payload[index++] = espCommands[command].command;
+	packSendPayload(payload, index);
+	espMismatch = false;
+}
+
+bool VescUart::espDecode(esp_commands command, uint8_t *message, int lenPay)
+{
+	const espCommand_t *entry = &espCommands[command];
+
+	if (entry->decode == NULL || lenPay < 3 || message[0] != COMM_CUSTOM_APP_DATA ||
+		message[1] != ESP32_COMMAND_ID || message[2] != entry->command)
+		return false;
+
+	// From here on it is a reply to command, failing means another layout
+	espMismatch = !replyLengthOk(lenPay, entry->minLen, entry->maxLen) ||
+				  !(this->*entry->decode)(message, lenPay);
+	return !espMismatch;
+}
 
+// Float package decoders, one per espCommands entry. espDecode() has checked
+// the packet id, magic number, command and length range; the fields start at
+// index 3.
+
+bool VescUart::readyDecode(uint8_t *message, int lenPay)
+{
+	/**
+		uint8_t ready;
+		uint8_t protocolVersion;	// newer packages only
+		uint16_t capabilities;
+	 */
+	int32_t index = 3;
+	isVescReady = (bool)message[index++];
+	protocolVersion = 0;
+	capabilities = 0;
+	if (lenPay - index >= 3)
 	{
-		debugPort->printf("message length:%d \n", lenPay);
+		protocolVersion = message[index++];
+		capabilities = buffer_get_uint16(message, &index);
 	}
-	message++; // Removes the packetId from the actual message (payload)
-	if (packetId == COMM_CUSTOM_APP_DATA)
+
+	// Packages with the handshake tell whether the compact frame is there. It
+	// stays off unless setSoundCompact() asked for it
+	if (protocolVersion > 0 && soundFormat != 0)
+		soundFormat = (capabilities & ESP_CAP_SOUND_COMPACT) ? 2 : 0;
+	handshakeDone = true;
+
+	if (debugPort != NULL)
 	{
+		debugPort->printf("VESC ready ?: %s\n", isVescReady ? "true":"false");
+		debugPort->printf("float version: %d capabilities: %x\n", protocolVersion, capabilities);
+	}
+	return true;
+}
 
-		uint8_t magicNum, command;
-		magicNum = (uint8_t)message[index++];
-		command = (uint8_t)message[index++];
+bool VescUart::soundDecode(uint8_t *message, int lenPay)
+{
+	/**
+		float pidOutput;
+		uint8_t swState;
+		float erpm;
+		float inputVoltage;
+		float motorCurrent
+	 */
+	int32_t index = 3;
+	if (!soundLayout::unpack(engineData, message, lenPay, &index))
+		return false;
 
-		if (lenPay < 2)
-		{
-			if (debugPort != NULL)
-				debugPort->printf("Float App: Missing Args\n");
-			return false;
-		}
+	if (debugPort != NULL)
+	{
+		debugPort->printf(" Pid Value		:%.2f\n", engineData.pidOutput);
+		debugPort->printf(" Switch State	:%d\n", (uint8_t)engineData.swState);
+		debugPort->printf(" ERPM			:%.2f\n", engineData.erpm);
+		debugPort->printf(" Input Voltage			:%.2f\n", engineData.inputVoltage);
+		debugPort->printf(" motor current			:%.2f\n", engineData.motorCurrent);
+	}
+	return true;
+}
 
-		if (magicNum != ESP32_COMMAND_ID)
+bool VescUart::advancedDecode(uint8_t *message, int lenPay)
+{
+	/**
+		uint8_t lights_mode;
+		uint8_t idle_warning_time;
+		uint16_t engine_sound_volume;
+		uint8_t over_speed_warning;
+		float battery_level;
+		uint8_t low_battery_warning_level;
+		uint8_t engine_sampling_data;
+	 */
+	int32_t index = 3;
+	if (!advancedLayout::unpack(settingData, message, lenPay, &index))
+		return false;
 
-		{
-			serialPort->printf(" Magic number wrong.\n");
-			return false;
-		}
-		if (magicNum == ESP32_COMMAND_ID)
-		{
+	if (debugPort != NULL)
+	{
+		debugPort->printf("lights_modee		:%d\n", settingData.lights_mode);
+		debugPort->printf("idle_warning_time	:%d\n", settingData.idle_warning_time);
+		debugPort->printf("engine sound volume	:%d\n", settingData.engine_sound_volume);
+		debugPort->printf("settingData.over_speed_warning	:%d\r\n", settingData.over_speed_warning);
+		debugPort->printf("settingData.battery level	:%.2f \r\n", settingData.battery_level);
+		debugPort->printf("settingData.low_battery_warning_level	:%.2f \r\n", settingData.low_battery_warning_level);
+		debugPort->printf("settingData.engine_sampling_data	:%d \r\n", settingData.engine_sampling_data);
+	}
+	return true;
+}
 
-			//
-			switch (command)
-			{
-			case ESP_COMMAND_ENGINE_SOUND_INFO:
-			{
-				/**
-					float pidOutput;
-					uint8_t swState;
-					float erpm;
-					float inputVoltage;
-					float motorCurrent
-
-				 */
-				engineData.pidOutput = buffer_get_float32_auto(message, &index);
-				engineData.swState = (uint8_t)message[index++];
-				engineData.erpm = buffer_get_float32_auto(message, &index);
-				engineData.inputVoltage=buffer_get_float32_auto(message, &index);
-				engineData.motorCurrent=buffer_get_float32_auto(message, &index);
-				if (debugPort != NULL)
-				{
-					debugPort->printf(" Pid Value		:%.2f\n", engineData.pidOutput);
-					debugPort->printf(" Switch State	:%d\n", (uint8_t)engineData.swState);
-					debugPort->printf(" ERPM			:%.2f\n", engineData.erpm);
-					debugPort->printf(" Input Voltage			:%.2f\n", engineData.inputVoltage);
-					debugPort->printf(" motor current			:%.2f\n", engineData.motorCurrent);
-				}
+bool VescUart::soundTriggeredDecode(uint8_t *message, int lenPay)
+{
+	// One byte after packet id, magic number and command
+	if (lenPay < 4)
+		return false;
 
-				return true;
-			}
+	soundTriggered = message[3];
 
-			case ESP_COMMAND_GET_ADV_INFO:
+	if (debugPort != NULL)
+		debugPort->printf("sound triggered data is : %d \n", soundTriggered);
+	return true;
+}
 
-			{
-				/**
-				 *
-				  uint8_t lights_mode;
-					uint8_t idle_warning_time;
-					uint16_t engine_sound_volume;
-					uint8_t over_speed_warning;
-  					float battery_level;
-  					float low_battery_warning_level;
-  					uint8_t engine_sampling_data;
-				 */
-				settingData.lights_mode = (uint8_t)message[index++];
-				settingData.idle_warning_time = (uint8_t)message[index++];
-				settingData.engine_sound_volume = buffer_get_uint16(message, &index);
-				settingData.over_speed_warning = (uint8_t)message[index++];
-				settingData.battery_level=buffer_get_float32_auto( message, &index);
-				settingData.low_battery_warning_level=(float) message[index++];
-				settingData.engine_sampling_data=(uint8_t)message[index++];
-				if (debugPort != NULL)
-				{
-					debugPort->printf("lights_modee		:%d\n", settingData.lights_mode);
-					debugPort->printf("idle_warning_time	:%d\n", settingData.idle_warning_time);
-					debugPort->printf("engine sound volume	:%d\n", settingData.engine_sound_volume);
-					debugPort->printf("settingData.over_speed_warning	:%d\r\n", settingData.over_speed_warning);
-					debugPort->printf("settingData.battery level	:%.2f \r\n", settingData.battery_level);
-					debugPort->printf("settingData.low_battery_warning_level	:%.2f \r\n", settingData.low_battery_warning_level);
-					debugPort->printf("settingData.engine_sampling_data	:%d \r\n", settingData.engine_sampling_data);
-					
-					}
+bool VescUart::enableItemDecode(uint8_t *message, int lenPay)
+{
+	// One byte after packet id, magic number and command
+	if (lenPay < 4)
+		return false;
 
-				return true;
-			}
+	enableItemData = message[3];
 
-			case ESP_COMMAND_ENABLE_ITEM_INFO:
-			{	
-				uint8_t temp = (uint8_t)message[index++];
-				if (enableItemData != temp )
-				{
-					enableItemData = temp;
-				}
+	if (debugPort != NULL)
+		debugPort->printf("Enable item data is : %d \n", enableItemData);
+	return true;
+}
 
-				if (debugPort != NULL)
-				{
-					debugPort->printf("Enable item data is : %d \n", enableItemData);
-				}
-				return true;
-			}
+bool VescUart::bundleDecode(uint8_t *message, int lenPay)
+{
+	/**
+		engine sound info, then
+		uint8_t soundTriggered;
+		uint8_t enableItemData;
+	 */
+	int32_t index = 3;
+	if (lenPay - index < soundLayout::size + 2)
+		return false;
 
-			case ESP_COMMAND_SOUND_GET:
-			{
-				soundTriggered = (uint8_t)message[index++];
-				if (debugPort != NULL)
-				{
-					debugPort->printf("sound triggered data is : %d \n", soundTriggered);
-				}
-				return true;
-			}
+	soundLayout::unpack(engineData, message, lenPay, &index);
+	soundTriggered = message[index++];
+	enableItemData = message[index++];
 
-			default:
-			{
-				debugPort->printf(" Unknow Float command !");
-				return true;
-			}
-			}
-		}
+	if (debugPort != NULL)
+	{
+		debugPort->printf(" ERPM			:%.2f\n", engineData.erpm);
+		debugPort->printf(" sound triggered	:%d\n", soundTriggered);
+		debugPort->printf(" enable item data	:%d\n", enableItemData);
 	}
-	return false ;
+	return true;
 }
 
 void VescUart::serialPrint(uint8_t *data, int len)
@@ -353,78 +706,127 @@ void VescUart::serialPrint(uint8_t *data, int len)
 	}
 }
 
+uint8_t VescUart::get_protocol_version(void)
+{
+	return protocolVersion;
+}
+
+uint16_t VescUart::get_capabilities(void)
+{
+	return capabilities;
+}
+
+bool VescUart::has_capability(esp_capability capability)
+{
+	return (capabilities & capability) != 0;
+}
+
+bool VescUart::replyLengthOk(int lenPay, int minLen, int maxLen)
+{
+	return lenPay >= minLen && (protocolVersion > 0 || lenPay <= maxLen);
+}
+
 bool VescUart::get_vesc_ready(void)
 {
-	
-	uint8_t message[256];
-	COMM_PACKET_ID packetId;
-	int32_t index = 0;
-	int payloadSize = 3;
-	//send command to vesc 
-	uint8_t payload[payloadSize];
-	payload[index++] = {COMM_CUSTOM_APP_DATA};
-	payload[index++] = ESP32_COMMAND_ID;
-	payload[index++] = ESP_COMMAND_GET_READY;//FLOAT_COMMAND_GET_INFO
-	packSendPayload(payload, payloadSize);
+	return espRequest(ESP_COMMAND_GET_READY) && isVescReady;
+}
 
-	//process received data 
-	index = 0;
-	int messageLength = receiveUartMessage(message);
+void VescUart::setSoundCompact(bool enable)
+{
+	soundFormat = enable ? 1 : 0;
+	soundCompactFails = 0;
+}
 
-	if (messageLength == 0)
-	{
+bool VescUart::is_sound_compact(void)
+{
+	return soundFormat == 2;
+}
+
+bool VescUart::soundDecodeCompact(uint8_t *message, int lenPay)
+{
+	/**
+		float16 pidOutput (1e2)
+		uint8_t swState
+		varint  erpm
+		float16 inputVoltage (1e2)
+		float16 motorCurrent (1e1)
+	 */
+	int32_t index = 3;
+	float pidOutput = buffer_get_float16(message, 1e2, &index);
+	uint8_t swState = message[index++];
+	int32_t erpm = buffer_get_varint(message, lenPay, &index);
+
+	if (!replyLengthOk(lenPay - index, 4, 4))
 		return false;
-	}
 
+	engineData.pidOutput = pidOutput;
+	engineData.swState = swState;
+	engineData.erpm = erpm;
+	engineData.inputVoltage = buffer_get_float16(message, 1e2, &index);
+	engineData.motorCurrent = buffer_get_float16(message, 1e1, &index);
+	return true;
+}
+
+bool VescUart::soundUpdate(void)
+{
 	if (debugPort != NULL)
-		debugPort->printf("message Length :%d\r\n", messageLength);
+	{
+		debugPort->println("soundUpdate();");
+	}
 
-	if (messageLength == 4)
+	if (soundFormat != 0)
 	{
-		packetId = (COMM_PACKET_ID)message[0];
-		if (packetId == COMM_CUSTOM_APP_DATA)
-		{
-			if (message[1] == ESP32_COMMAND_ID && message[2] == ESP_COMMAND_GET_READY )
-			{   
-				
-				if (debugPort != NULL)
-					debugPort->printf("VESC ready ?: %s\n", (bool) message[3] ? "true":"false");
-				return (bool) message[3];
-			} 
-		} 
+		bool ok = espRequest(ESP_COMMAND_ENGINE_SOUND_COMPACT);
+		soundCompactResult(ok);
+		if (ok || soundFormat == 2)
+			return ok;
+	}
+
+	return espRequest(ESP_COMMAND_ENGINE_SOUND_INFO);
+}
+
+void VescUart::soundCompactResult(bool answered)
+{
+	if (answered)
+	{
+		soundFormat = 2;
+		soundCompactFails = 0;
+		return;
 	}
 
+	if (soundFormat != 1)
+		return;
+
+	// A reply in another layout settles it, a missing one may just be lost
+	if (!espMismatch && ++soundCompactFails < VESC_SOUND_COMPACT_TRIES)
+		return;
+
+	// The package only knows the 20 byte layout
 	if (debugPort != NULL)
-		debugPort->printf("float version: 0\n");
-	
-	return false ;
-	
+		debugPort->println("Compact sound frame not supported");
+	soundFormat = 0;
 }
 
-bool VescUart::soundUpdate(void)
+bool VescUart::bundleUpdate(void)
 {
 	if (debugPort != NULL)
 	{
-		debugPort->println("soundUpdate();");
+		debugPort->println("bundleUpdate();");
 	}
 
-	int32_t index = 0;
-	int payloadSize = 3;
-	uint8_t payload[payloadSize];
-	payload[index++] = {COMM_CUSTOM_APP_DATA};
-	payload[index++] = ESP32_COMMAND_ID; // surfdado's magic number
-	payload[index++] = {ESP_COMMAND_ENGINE_SOUND_INFO};
-	packSendPayload(payload, payloadSize);
+	// Packages without the bundle never answer it, ask which one this is first
+	if (!handshakeDone && !espRequest(ESP_COMMAND_GET_READY))
+		return false;
 
-	uint8_t message[256];
-	int messageLength = receiveUartMessage(message);
-	if (debugPort != NULL)
-		debugPort->printf("message Length :%d\r\n", messageLength);
-	if (messageLength == 20 )
+	if (!(capabilities & ESP_CAP_BUNDLE))
 	{
-		return processReadPacket(message, messageLength);
+		bool ok = soundUpdate();
+		get_sound_triggered();
+		get_enable_item_data();
+		return ok;
 	}
-	return false;
+
+	return espRequest(ESP_COMMAND_GET_BUNDLE);
 }
 
 bool VescUart::advancedUpdate(void)
@@ -433,24 +835,8 @@ bool VescUart::advancedUpdate(void)
 	{
 		debugPort->printf("Send Command\n");
 	}
-	int32_t index = 0;
-	int payloadSize = 3;
-	uint8_t payload[payloadSize];
-	payload[index++] = {COMM_CUSTOM_APP_DATA};
-	payload[index++] = ESP32_COMMAND_ID;							 // surfdado's magic number
-	payload[index++] = {ESP_COMMAND_GET_ADV_INFO}; // float command
-	packSendPayload(payload, payloadSize);
-
-	uint8_t message[256];
-	int messageLength = receiveUartMessage(message);
-	if (debugPort != NULL)
-		debugPort->printf("message Length :%d\r\n", messageLength);
-	if (messageLength == 14 )
-	{
-		return processReadPacket(message, messageLength);
-	}
 
-	return false;
+	return espRequest(ESP_COMMAND_GET_ADV_INFO);
 }
 
 
@@ -548,52 +934,26 @@ uint8_t VescUart::get_enable_item_data(void)
    if (debugPort != NULL)
 		debugPort->printf("get_enable_item_data :\n");
 
-   int32_t index = 0;
-   int payloadSize = 3;
-   uint8_t message[256];
-   uint8_t payload[payloadSize];
-   payload[index++] = {COMM_CUSTOM_APP_DATA};
-   payload[index++] = ESP32_COMMAND_ID;
-   payload[index++] = {ESP_COMMAND_ENABLE_ITEM_INFO}; // enable item data
-   // write
-   packSendPayload(payload, payloadSize);
-   // read
-   int messageLength = receiveUartMessage(message);
-   if (debugPort != NULL)
-		debugPort->printf("get message length is :%d\n", messageLength);
-   if (messageLength ==4)
-   {
-		 processReadPacket(message, messageLength);
-		
-   }
-   
+   espRequest(ESP_COMMAND_ENABLE_ITEM_INFO);
    return enableItemData;
 }
 
+uint8_t VescUart::get_last_sound_triggered(void)
+{
+	return soundTriggered;
+}
+
+uint8_t VescUart::get_last_enable_item_data(void)
+{
+	return enableItemData;
+}
+
 uint8_t VescUart::get_sound_triggered(void)
 {
 	if (debugPort != NULL)
 		debugPort->println("get_sound_triggered");
-		if (debugPort != NULL)
-	{
-		debugPort->printf("Send Command\n");
-	}
-	int32_t index = 0;
-	int payloadSize = 3;
-	uint8_t payload[payloadSize];
-	payload[index++] = {COMM_CUSTOM_APP_DATA};
-	payload[index++] = ESP32_COMMAND_ID;					
-	payload[index++] = {ESP_COMMAND_SOUND_GET}; // get button triggered data 
-	packSendPayload(payload, payloadSize);
 
-	uint8_t message[256];
-	int messageLength = receiveUartMessage(message);
-	if (debugPort != NULL)
-		debugPort->printf("get message length is :%d\n", messageLength);
-	if (messageLength>=4)
-	{
-		if( processReadPacket(message, messageLength)  ) 
+	if (espRequest(ESP_COMMAND_SOUND_GET))
 		return soundTriggered;
-	}
 	return 0;
 }
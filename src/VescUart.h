@@ -5,6 +5,10 @@
 #include "datatypes.h"
 #include "buffer.h"
 #include "crc.h"
+#include "VescConfigStorage.h"
+#include "linering.h"
+#include "VescCodec.h"
+#include "VescReplay.h"
 #define ESP32_COMMAND_ID 102
 typedef enum
 {
@@ -17,9 +21,20 @@ typedef enum
 	ESP_COMMAND_SOUND_SET,
    //enable item data
   ESP_COMMAND_ENABLE_ITEM_INFO,
+  // engine sound info, sound trigger and enable item data in one reply
+  ESP_COMMAND_GET_BUNDLE,
+  // engine sound info in the compact layout, see setSoundCompact()
+  ESP_COMMAND_ENGINE_SOUND_COMPACT,
 
 } esp_commands;
 
+// Features announced in the ESP_COMMAND_GET_READY reply
+typedef enum
+{
+  ESP_CAP_BUNDLE = 1 << 0,        // ESP_COMMAND_GET_BUNDLE
+  ESP_CAP_SOUND_COMPACT = 1 << 1, // ESP_COMMAND_ENGINE_SOUND_COMPACT
+} esp_capability;
+
 typedef enum
 {
 	SOUND_HORN_TRIGGERED ,
@@ -29,6 +44,149 @@ typedef enum
 
 
 
+// Wire encoding of a field in a serialised mc_configuration / app_configuration
+typedef enum
+{
+  CONF_FIELD_UINT8 = 0,
+  CONF_FIELD_INT8,
+  CONF_FIELD_BOOL,
+  CONF_FIELD_UINT16,
+  CONF_FIELD_INT16,
+  CONF_FIELD_UINT32,
+  CONF_FIELD_INT32,
+  CONF_FIELD_FLOAT16,     // int16 / scale
+  CONF_FIELD_FLOAT32,     // int32 / scale
+  CONF_FIELD_FLOAT32_AUTO,
+} conf_field_type;
+
+// Bytes a field of the given type takes on the wire
+uint8_t conf_field_size(conf_field_type type);
+
+// Name of a fault code without the FAULT_CODE_ prefix, "UNKNOWN" if out of range
+const char *fault_code_name(mc_fault_code fault);
+
+// Most fields a single getMcconf() / getAppconf() call can select
+#ifndef VESC_CONF_MAX_FIELDS
+#define VESC_CONF_MAX_FIELDS 32
+#endif
+
+// Custom config (package settings): XML chunk size, XML requests in flight and
+// slots of the name index (power of two). The binary config goes to the
+// storage given to setCustomConfigStorage()
+#ifndef VESC_CUSTOM_CONFIG_CHUNK
+#define VESC_CUSTOM_CONFIG_CHUNK 400
+#endif
+#ifndef VESC_CUSTOM_CONFIG_WINDOW
+#define VESC_CUSTOM_CONFIG_WINDOW 3
+#endif
+#ifndef VESC_CUSTOM_CONFIG_INDEX_SIZE
+#define VESC_CUSTOM_CONFIG_INDEX_SIZE 128
+#endif
+
+// Firmware upload: bytes per write, writes in flight, retries of a window and
+// how long the VESC may take to erase the new app area
+#ifndef VESC_FW_CHUNK
+#define VESC_FW_CHUNK 384
+#endif
+#ifndef VESC_FW_WINDOW
+#define VESC_FW_WINDOW 4
+#endif
+#ifndef VESC_FW_RETRIES
+#define VESC_FW_RETRIES 3
+#endif
+#ifndef VESC_FW_ERASE_TIMEOUT
+#define VESC_FW_ERASE_TIMEOUT 20000
+#endif
+
+// Log fields kept by the log ring and the length of their stored names
+#ifndef VESC_LOG_MAX_FIELDS
+#define VESC_LOG_MAX_FIELDS 16
+#endif
+#ifndef VESC_LOG_NAME_LEN
+#define VESC_LOG_NAME_LEN 16
+#endif
+
+// File transfer: bytes per write, requests in flight, retries of a window and
+// longest path
+#ifndef VESC_FILE_CHUNK
+#define VESC_FILE_CHUNK 384
+#endif
+#ifndef VESC_FILE_WINDOW
+#define VESC_FILE_WINDOW 3
+#endif
+#ifndef VESC_FILE_RETRIES
+#define VESC_FILE_RETRIES 3
+#endif
+#ifndef VESC_FILE_MAX_PATH
+#define VESC_FILE_MAX_PATH 64
+#endif
+
+// LispBM: stream code chunk size and chunks in flight, size of the print
+// capture ring, bindings kept from COMM_LISP_GET_STATS
+#ifndef VESC_LISP_CHUNK
+#define VESC_LISP_CHUNK 384
+#endif
+#ifndef VESC_LISP_WINDOW
+#define VESC_LISP_WINDOW 2
+#endif
+#ifndef VESC_LISP_RETRIES
+#define VESC_LISP_RETRIES 5
+#endif
+#ifndef VESC_LISP_MAX_BINDINGS
+#define VESC_LISP_MAX_BINDINGS 8
+#endif
+
+// Terminal: commands waiting to be sent,
+// longest command, quiet time that ends a COMM_TERMINAL_CMD reply and the
+// longest time a command may take
+#ifndef VESC_TERMINAL_QUEUE
+#define VESC_TERMINAL_QUEUE 4
+#endif
+#ifndef VESC_TERMINAL_CMD_LEN
+#define VESC_TERMINAL_CMD_LEN 64
+#endif
+#ifndef VESC_TERMINAL_IDLE
+#define VESC_TERMINAL_IDLE 100
+#endif
+#ifndef VESC_TERMINAL_TIMEOUT
+#define VESC_TERMINAL_TIMEOUT 2000
+#endif
+
+// Fault monitor: fault edges kept in RAM, controllers (CAN ids) tracked
+#ifndef VESC_FAULT_HISTORY
+#define VESC_FAULT_HISTORY 8
+#endif
+#ifndef VESC_FAULT_DEVICES
+#define VESC_FAULT_DEVICES 4
+#endif
+
+// Setpoints: shortest time between two sends of the same command (newer values
+// replace the pending one meanwhile), and the COMM_ALIVE period while no
+// setpoint is sent
+#ifndef VESC_SETPOINT_INTERVAL
+#define VESC_SETPOINT_INTERVAL 10
+#endif
+#ifndef VESC_ALIVE_INTERVAL
+#define VESC_ALIVE_INTERVAL 250
+#endif
+
+// IMU samples kept for interpolation
+#ifndef VESC_IMU_HISTORY
+#define VESC_IMU_HISTORY 8
+#endif
+
+// Unanswered compact sound requests in a row before soundUpdate() settles on
+// the 20 byte layout
+#ifndef VESC_SOUND_COMPACT_TRIES
+#define VESC_SOUND_COMPACT_TRIES 3
+#endif
+
+// balanceSoundUpdate() bursts without the balance request after it went
+// unanswered
+#ifndef VESC_BALANCE_RETRY
+#define VESC_BALANCE_RETRY 50
+#endif
+
 //Determine the function of a certain bit
 typedef enum
 {
@@ -37,13 +195,25 @@ ENGINE_SOUND_ENABLE_MASK_BIT,
 START_UP_WARNING_ENABLE_MASK_BIT,
 } float_enable_mask;
 
+// COMM_GET_IMU_DATA field groups, one bit per axis
+typedef enum
+{
+  IMU_MASK_RPY = 0x0007,  // roll, pitch, yaw
+  IMU_MASK_ACC = 0x0038,
+  IMU_MASK_GYRO = 0x01C0,
+  IMU_MASK_MAG = 0x0E00,
+  IMU_MASK_QUAT = 0xF000,
+} imu_mask;
+
 
 
   class VescUart
   {
-
   // Timeout - specifies how long the function will wait for the vesc to respond
   const uint32_t _TIMEOUT;
+  
+public:
+
  /**This data structure is used for engine sound */
   struct soundData_t
   { float pidOutput;
@@ -64,8 +234,65 @@ START_UP_WARNING_ENABLE_MASK_BIT,
   float low_battery_warning_level;
   uint8_t engine_sampling_data;
   };
-  
-public:
+
+  // Wire layouts of the replies above, after packet id, magic number and command.
+  // Public so that a peer, like the host simulator, packs the same layout
+  typedef codec_layout<
+    codec_field<soundData_t, float, &soundData_t::pidOutput, CODEC_FLOAT32_AUTO>,
+    codec_field<soundData_t, uint8_t, &soundData_t::swState, CODEC_UINT8>,
+    codec_field<soundData_t, float, &soundData_t::erpm, CODEC_FLOAT32_AUTO>,
+    codec_field<soundData_t, float, &soundData_t::inputVoltage, CODEC_FLOAT32_AUTO>,
+    codec_field<soundData_t, float, &soundData_t::motorCurrent, CODEC_FLOAT32_AUTO> >
+    soundLayout;
+
+  typedef codec_layout<
+    codec_field<advancedData_t, uint8_t, &advancedData_t::lights_mode, CODEC_UINT8>,
+    codec_field<advancedData_t, uint8_t, &advancedData_t::idle_warning_time, CODEC_UINT8>,
+    codec_field<advancedData_t, uint16_t, &advancedData_t::engine_sound_volume, CODEC_UINT16>,
+    codec_field<advancedData_t, uint8_t, &advancedData_t::over_speed_warning, CODEC_UINT8>,
+    codec_field<advancedData_t, float, &advancedData_t::battery_level, CODEC_FLOAT32_AUTO>,
+    // whole percent on the wire
+    codec_field<advancedData_t, float, &advancedData_t::low_battery_warning_level, CODEC_UINT8>,
+    codec_field<advancedData_t, uint8_t, &advancedData_t::engine_sampling_data, CODEC_UINT8> >
+    advancedLayout;
+
+  /** Callback used by receiveUartStream() to hand over payload bytes as they arrive */
+  typedef void (*payloadSink_t)(void *context, const uint8_t *data, uint16_t len);
+
+  /**
+   * COMM_BMS_GET_VALUES summary. The variable-length cell and temperature
+   * arrays are not kept here, they are streamed into the storage given to
+   * setBmsCellStorage() / setBmsTempStorage()
+   */
+  struct bmsData_t
+  {
+    float v_tot;
+    float v_charge;
+    float i_in;
+    float i_in_ic;
+    float ah_cnt;
+    float wh_cnt;
+    uint8_t cell_num;
+    float v_cell_min;
+    float v_cell_max;
+    float v_cell_avg;
+    float v_cell_imbalance; // v_cell_max - v_cell_min
+    uint8_t temp_adc_num;
+    float temp_adc_min;
+    float temp_adc_max;
+    float temp_adc_avg;
+    float temp_ic;
+    float temp_hum;
+    float hum;
+    float temp_max_cell;
+    float soc;
+    float soh;
+    uint8_t can_id;
+    float ah_cnt_chg_total;
+    float wh_cnt_chg_total;
+    float ah_cnt_dis_total;
+    float wh_cnt_dis_total;
+  };
 
 
   /**
@@ -85,17 +312,66 @@ public:
    */
   void setDebugPort(Stream *port);
 
-  /**Send uart command function*/
+  /**
+   * @brief      Capture every chunk read from or written to the UART, with
+   *             its time and direction, in the format of VescReplay.h. Feed
+   *             the log back through VescReplay to reproduce a session
+   * @param      log  - Where the capture goes (SD file, host file), NULL stops
+   */
+  void setCapture(Print *log);
+
+  /**
+   * @brief      Ask the float package if it is ready. Newer packages add their
+   *             protocol version and capability bits to the reply, they are
+   *             kept for the session: replies may then grow at the end, and
+   *             bundled / compact frames are used when announced
+   * @return     The ready flag
+   */
   bool get_vesc_ready(void);
 
+  /**Protocol version from the last ready reply, 0 for packages without the handshake */
+  uint8_t get_protocol_version(void);
+  /**esp_capability bits from the last ready reply */
+  uint16_t get_capabilities(void);
+  bool has_capability(esp_capability capability);
+
   bool soundUpdate(void);
 
+  /**
+   * @brief      Let soundUpdate() ask for the compact engine sound frame
+   *             (float16 PID output, voltage and current, varint erpm; 11 to
+   *             13 bytes instead of 20). Off by default, the capabilities of
+   *             the ready reply never turn it on. With a package that reports
+   *             them it is only used when ESP_CAP_SOUND_COMPACT is set. Else
+   *             the first soundUpdate() of the session negotiates it; a VESC
+   *             that answers the compact request in another layout, or leaves
+   *             VESC_SOUND_COMPACT_TRIES requests in a row unanswered, is
+   *             polled with the 20 byte layout from then on
+   */
+  void setSoundCompact(bool enable);
+  /**True once the VESC answered a compact request */
+  bool is_sound_compact(void);
+
   bool advancedUpdate(void);
 
 uint8_t get_enable_item_data(void);
 
   uint8_t get_sound_triggered(void);
 
+  /**
+   * @brief      soundUpdate(), get_sound_triggered() and get_enable_item_data()
+   *             with one ESP_COMMAND_GET_BUNDLE round trip. Sound values are
+   *             read with the sound getters, the two bytes with the getters below.
+   *             The first call does the get_vesc_ready() handshake if it has
+   *             not been done; without ESP_CAP_BUNDLE the three requests are
+   *             sent one after the other instead
+   * @return     True if the bundle (or the sound reply) was received
+   */
+  bool bundleUpdate(void);
+  /**Trigger bits / enable item data of the last reply, without a request */
+  uint8_t get_last_sound_triggered(void);
+  uint8_t get_last_enable_item_data(void);
+
   /**
    *Only return data, need to use the above function to update
    */
@@ -113,7 +389,636 @@ uint8_t get_enable_item_data(void);
   float get_low_battery_warning_level(void);
 //Use motor current , Erpm , pid as engine throttle
 uint8_t get_engine_sampling(void);
+
+  /**
+   * @brief      Request COMM_BMS_GET_VALUES and decode it while it is received
+   *
+   * @param      canId  - CAN id of the BMS, 0 for the local device
+   * @return     True if a complete frame with a valid CRC was decoded
+   */
+  bool bmsUpdate(uint8_t canId = 0);
+
+  /**
+   * @brief      Select the cells copied out of the next bmsUpdate() calls.
+   *             Pass NULL / 0 to keep only the summary
+   *
+   * @param      v_cell     - Storage for count cell voltages (may be NULL)
+   * @param      bal_state  - Storage for count balancing states (may be NULL)
+   * @param      first      - Index of the first cell to copy
+   * @param      count      - Number of cells to copy
+   */
+  void setBmsCellStorage(float *v_cell, bool *bal_state, uint8_t first, uint8_t count);
+
+  /**
+   * @brief      Select the temperature sensors copied out of the next bmsUpdate() calls
+   *
+   * @param      temps  - Storage for count temperatures (may be NULL)
+   * @param      first  - Index of the first sensor to copy
+   * @param      count  - Number of sensors to copy
+   */
+  void setBmsTempStorage(float *temps, uint8_t first, uint8_t count);
+
+  /**Only valid after bmsUpdate() returned true */
+  const bmsData_t &get_bms_data(void);
+
+  /**
+   * One field to pick out of a serialised configuration. offset is the byte
+   * offset inside the serialised struct (0 is the 4 byte signature), as
+   * written by confgenerator.c of the firmware that is talked to. dest must
+   * point to the C type matching type (float for the FLOAT types).
+   */
+  struct confField_t
+  {
+    uint16_t offset;
+    conf_field_type type;
+    float scale;
+    void *dest;
+  };
+
+  /**
+   * @brief      Read selected fields of the motor configuration (COMM_GET_MCCONF).
+   *             The reply is decoded while it is received, nothing is written to
+   *             the destinations unless the whole frame had a valid CRC
+   *
+   * @param      fields     - Fields sorted by offset, at most VESC_CONF_MAX_FIELDS
+   * @param      count      - Number of fields
+   * @param      signature  - Expected MCCONF_SIGNATURE, 0 to accept any
+   * @param      canId      - CAN id, 0 for the local device
+   * @return     True if all fields were received and stored
+   */
+  bool getMcconf(const confField_t *fields, uint8_t count, uint32_t signature = 0, uint8_t canId = 0);
+
+  /**
+   * @brief      Same as getMcconf() for the app configuration (COMM_GET_APPCONF)
+   */
+  bool getAppconf(const confField_t *fields, uint8_t count, uint32_t signature = 0, uint8_t canId = 0);
+
+  /**Signature of the last configuration read with getMcconf() / getAppconf() */
+  uint32_t get_conf_signature(void);
+
+  /**
+   * Limits overridden at runtime with COMM_SET_MCCONF_TEMP(_SETUP). They are
+   * not stored in flash unless asked for. With the _SETUP variant min_erpm and
+   * max_erpm are speeds in m/s and the watt limits are for the whole setup.
+   */
+  struct tempLimits_t
+  {
+    float current_min_scale;
+    float current_max_scale;
+    float min_erpm;
+    float max_erpm;
+    float min_duty;
+    float max_duty;
+    float watt_min;
+    float watt_max;
+    float in_current_min;
+    float in_current_max;
+  };
+
+  /**
+   * @brief      Apply runtime limits with COMM_SET_MCCONF_TEMP and wait for the ack.
+   *             Nothing is sent if the limits equal the last ones applied
+   *
+   * @param      limits      - The limits to apply
+   * @param      forwardCan  - Let the VESC forward the limits to the CAN bus
+   * @param      store       - Also write them to flash (slow, wears the flash)
+   * @param      canId       - CAN id, 0 for the local device
+   * @return     True if the VESC acknowledged the limits (or nothing had to be sent)
+   */
+  bool setMcconfTemp(const tempLimits_t &limits, bool forwardCan = false, bool store = false, uint8_t canId = 0);
+
+  /**
+   * @brief      Same as setMcconfTemp() with COMM_SET_MCCONF_TEMP_SETUP, where
+   *             speeds are in m/s and the watt limits are for the whole setup
+   *
+   * @param      divide  - Let each controller take its share of the watt
+   *                       limits instead of the full value
+   */
+  bool setMcconfTempSetup(const tempLimits_t &limits, bool forwardCan = false, bool store = false, uint8_t canId = 0, bool divide = false);
+
+  /**Last limits acknowledged by the VESC */
+  const tempLimits_t &get_temp_limits(void);
+  /**Round trip of the last limit change in microseconds, 0 if nothing was sent */
+  uint32_t get_temp_limits_latency(void);
+
+  /**
+   * One setting of the custom config, as listed by the package's generated
+   * confparser. offset is relative to the serialised config (0 is the signature).
+   */
+  struct customField_t
+  {
+    const char *name;
+    uint16_t offset;
+    conf_field_type type;
+    float scale;
+  };
+
+  /**
+   * @brief      Storage for the binary custom config, it has to hold the whole
+   *             config (a few hundred bytes). Without it customConfigSync()
+   *             fails and no setting can be read
+   *
+   * @param      storage  - Buffer for the config
+   * @param      size     - Size of storage in bytes
+   */
+  void setCustomConfigStorage(uint8_t *storage, uint16_t size);
+
+  /**
+   * @brief      Read the custom (package) config and make sure its XML description is
+   *             in storage. The XML is only downloaded when the stored copy was made
+   *             for another config signature or size; it is fetched in
+   *             VESC_CUSTOM_CONFIG_CHUNK byte chunks with several requests in flight
+   *
+   * @param      storage  - Cache for the XML, NULL to only read the binary config
+   * @param      confInd  - Index of the custom config (0 for the first package)
+   * @param      canId    - CAN id, 0 for the local device
+   * @return     True if the binary config was read and the stored XML is current
+   */
+  bool customConfigSync(VescConfigStorage *storage, uint8_t confInd = 0, uint8_t canId = 0);
+
+  /**
+   * @brief      Build the name index used by get_custom_config() / set_custom_config()
+   *
+   * @param      fields  - Field table, must stay valid while it is in use
+   * @param      count   - Number of fields, at most 3/4 of VESC_CUSTOM_CONFIG_INDEX_SIZE
+   * @return     False if the table does not fit in the index
+   */
+  bool setCustomConfigFields(const customField_t *fields, uint8_t count);
+
+  /**Value of a setting of the last config read, NAN if unknown */
+  float get_custom_config(const char *name);
+
+  /**Change a setting locally, send it with customConfigWrite() */
+  bool set_custom_config(const char *name, float value);
+
+  /**
+   * @brief      Send the local config with COMM_SET_CUSTOM_CONFIG and wait for the ack
+   */
+  bool customConfigWrite(uint8_t confInd = 0, uint8_t canId = 0);
+
+  /**Signature of the custom config and size of its XML description */
+  uint32_t get_custom_config_signature(void);
+  uint32_t get_custom_config_xml_size(void);
+
+  /**
+   * Compressor for firmware chunks, e.g. a wrapper around minilzo's lzo1x_1_compress().
+   * Returns the compressed size, or 0 to send the chunk uncompressed.
+   */
+  typedef uint16_t (*fwCompress_t)(const uint8_t *in, uint16_t len, uint8_t *out, uint16_t outSize);
+
+  /**
+   * @brief      Send chunks with COMM_WRITE_NEW_APP_DATA_LZO, compressed by compress.
+   *             NULL (the default) uses COMM_WRITE_NEW_APP_DATA
+   */
+  void setFirmwareCompressor(fwCompress_t compress);
+
+  /**
+   * @brief      Write a firmware image to the new app area of the VESC. The image is read
+   *             from image as it is sent; only the VESC_FW_WINDOW chunks in flight are
+   *             kept in RAM, in a static buffer shared by all instances, so one upload
+   *             runs at a time. The size/CRC header the bootloader checks is written
+   *             last, so an interrupted upload is never taken for a valid image.
+   *
+   * @param      image         - Source, positioned at the start of the image
+   * @param      size          - Image size in bytes
+   * @param      expectedCrc   - CRC16 of the image, checked before the header is written (0 to skip)
+   * @param      resumeOffset  - get_firmware_progress() of an interrupted upload of the same
+   *                             image to continue it without erasing, 0 for a new upload
+   * @param      canId         - CAN id, 0 for the local device
+   * @return     True if the whole image and its header were acknowledged, false
+   *             also while another upload is running
+   */
+  bool firmwareUpload(Stream *image, uint32_t size, uint16_t expectedCrc = 0, uint32_t resumeOffset = 0, uint8_t canId = 0);
+
+  /**Bytes of the image acknowledged by the VESC during the last firmwareUpload() */
+  uint32_t get_firmware_progress(void);
+
+  /**
+   * @brief      Let the VESC reboot into the bootloader to flash the uploaded image
+   */
+  void firmwareJumpToBootloader(uint8_t canId = 0);
+
+  /** A log column as announced with COMM_LOG_CONFIG_FIELD */
+  struct logField_t
+  {
+    char name[VESC_LOG_NAME_LEN];
+    uint8_t precision;
+    bool isRelative;
+    bool isTimestamp;
+  };
+
+  /**
+   * @brief      Handle frames the VESC sends on its own (log rows, prints, ...).
+   *             Call it from loop(); it returns at once when nothing was received
+   *             and also sends queued terminal commands, pending setpoints and
+   *             the keepalive.
+   *             Such frames arriving while waiting for a reply are handled too.
+   */
+  void poll(void);
+
+  /**
+   * @brief      Storage for the log ring, split in one column per field when
+   *             the VESC starts a log (COMM_LOG_START). Rows that do not fit
+   *             overwrite the oldest ones
+   *
+   * @param      storage  - Buffer for the columns
+   * @param      size     - Number of floats in storage
+   */
+  void setLogStorage(float *storage, uint16_t size);
+
+  /**True between COMM_LOG_START and COMM_LOG_STOP */
+  bool is_log_running(void);
+  uint8_t get_log_field_count(void);
+  const logField_t *get_log_field(uint8_t field);
+  /**Rows in the ring, at most get_log_capacity() */
+  uint16_t get_log_rows(void);
+  uint16_t get_log_capacity(void);
+  /**Rows lost because the ring was full before logFlush() read them */
+  uint32_t get_log_overruns(void);
+
+  /**
+   * @brief      Value of a field, age 0 is the newest row
+   */
+  float get_log_value(uint8_t field, uint16_t age);
+
+  /**
+   * @brief      Min, max and mean of a field over the newest rows
+   *
+   * @param      field  - Column
+   * @param      rows   - Number of newest rows, clipped to get_log_rows()
+   * @return     False if there is no such field or no row yet
+   */
+  bool logWindow(uint8_t field, uint16_t rows, float *min, float *max, float *mean);
+
+  /**
+   * @brief      Write the rows not flushed yet to out (SD card File, host file, ...).
+   *             The first flush of a log writes a header with the field names.
+   *             Format: "VLOG", field count, names (0 terminated), then rows of
+   *             float32_auto values as in buffer.h
+   *
+   * @return     Number of rows written
+   */
+  uint16_t logFlush(Print *out);
+
+  /** One entry of fileList() */
+  struct fileEntry_t
+  {
+    char name[VESC_FILE_MAX_PATH];
+    bool isDir;
+    int32_t size;
+  };
+
+  /**
+   * @brief      List a directory with COMM_FILE_LIST
+   *
+   * @param      path     - Directory on the VESC
+   * @param      entries  - Storage for the entries
+   * @param      max      - Size of entries
+   * @param      from     - Continue after this name (from a previous call with more set), or NULL
+   * @param      more     - Set if the directory has more entries, may be NULL
+   * @return     Number of entries stored, -1 on error
+   */
+  int fileList(const char *path, fileEntry_t *entries, uint8_t max, const char *from = NULL, bool *more = NULL, uint8_t canId = 0);
+
+  /**
+   * @brief      Download a file with COMM_FILE_READ. Several chunk requests are kept
+   *             in flight, every reply is checked for its offset and frame CRC before
+   *             it is written to out. Call again with get_file_progress() to resume
+   *
+   * @param      path    - File on the VESC
+   * @param      out     - Destination (SD card File, Serial, ...)
+   * @param      offset  - Where to start, 0 for the whole file
+   * @return     True if the file was read to the end
+   */
+  bool fileRead(const char *path, Print *out, uint32_t offset = 0, uint8_t canId = 0);
+
+  /**
+   * @brief      Upload a file with COMM_FILE_WRITE, keeping up to VESC_FILE_WINDOW chunks
+   *             in flight. Call again with get_file_progress() to resume
+   *
+   * @param      path    - File on the VESC
+   * @param      in      - Source, positioned at offset
+   * @param      size    - Total file size
+   * @param      offset  - Where to start, 0 for the whole file
+   * @return     True if every chunk was acknowledged
+   */
+  bool fileWrite(const char *path, Stream *in, uint32_t size, uint32_t offset = 0, uint8_t canId = 0);
+
+  bool fileMkdir(const char *path, uint8_t canId = 0);
+  bool fileRemove(const char *path, uint8_t canId = 0);
+
+  /**Offset reached by the last fileRead() / fileWrite() */
+  uint32_t get_file_progress(void);
+  /**Size of the file of the last fileRead() */
+  uint32_t get_file_size(void);
+  /**CRC16 of the bytes moved by the last fileRead() / fileWrite() call */
+  uint16_t get_file_crc(void);
+
+  /** COMM_LISP_GET_STATS reply, percentages */
+  struct lispStats_t
+  {
+    float cpu_use;
+    float heap_use;
+    float mem_use;
+    float stack_use;
+    char done_ctx_r[32];
+    uint8_t bindingNum;
+    char bindingName[VESC_LISP_MAX_BINDINGS][16];
+    float bindingValue[VESC_LISP_MAX_BINDINGS];
+  };
+
+  /**
+   * @brief      Run code with COMM_LISP_STREAM_CODE without storing it in flash.
+   *             Chunks are sent with the offset/total size handshake, up to
+   *             VESC_LISP_WINDOW in flight. A chunk the VESC cannot take yet
+   *             (negative result) is sent again after a short pause
+   *
+   * @param      code     - Source of the code
+   * @param      size     - Code size in bytes
+   * @param      restart  - Restart mode sent with the first chunk (1 restarts LispBM)
+   * @param      canId    - CAN id, 0 for the local device
+   * @return     True if all chunks were accepted
+   */
+  bool lispStreamCode(Stream *code, uint32_t size, uint8_t restart = 1, uint8_t canId = 0);
+
+  /**
+   * @brief      Send an expression to the REPL, its output arrives as
+   *             COMM_LISP_PRINT and is read with lispReadPrint()
+   */
+  void lispReplCmd(const char *cmd, uint8_t canId = 0);
+
+  /**
+   * @brief      Ring for COMM_LISP_PRINT lines, e.g. 512 bytes. Without it
+   *             the lines are dropped
+   *
+   * @param      storage  - Buffer for the ring
+   * @param      size     - Size of storage in bytes
+   */
+  void setLispPrintStorage(char *storage, uint16_t size);
+
+  /**
+   * @brief      Pop the oldest captured COMM_LISP_PRINT line
+   * @return     Length of the line, -1 if there is none
+   */
+  int lispReadPrint(char *line, uint16_t size);
+  /**Print lines waiting to be read */
+  uint16_t get_lisp_print_lines(void);
+  /**Print lines dropped because the ring was full */
+  uint32_t get_lisp_print_dropped(void);
+
+  /**
+   * @brief      Poll COMM_LISP_GET_STATS at most every interval_ms
+   * @param      interval_ms  - Slow schedule, e.g. 1000
+   * @return     True if new stats were received
+   */
+  bool lispStatsUpdate(uint32_t interval_ms = 1000, uint8_t canId = 0);
+  const lispStats_t &get_lisp_stats(void);
+
+  /**
+   * Called from poll() when a terminal command is done: the VESC answered a
+   * sync command, or printed nothing for VESC_TERMINAL_IDLE ms. timedOut is
+   * set when the command ran into VESC_TERMINAL_TIMEOUT instead
+   */
+  typedef void (*terminalDone_t)(void *context, const char *cmd, uint16_t lines, bool timedOut);
+
+  /**
+   * @brief      Queue a terminal command ("faults", "hw_status", ...). It is
+   *             sent from poll() once the previous one is done, its COMM_PRINT
+   *             output is read line by line with terminalReadLine()
+   *
+   * @param      cmd      - Command line
+   * @param      done     - Completion callback, may be NULL
+   * @param      context  - Passed back to done
+   * @param      sync     - Use COMM_TERMINAL_CMD_SYNC, the VESC marks the end of the output
+   * @param      canId    - CAN id, 0 for the local device
+   * @return     False if the queue is full
+   */
+  bool terminalCmd(const char *cmd, terminalDone_t done = NULL, void *context = NULL, bool sync = false, uint8_t canId = 0);
+
+  /**
+   * @brief      Ring for the COMM_PRINT output of terminal commands, e.g. 1024
+   *             bytes. Without it the lines are only counted for terminalDone_t
+   *
+   * @param      storage  - Buffer for the ring
+   * @param      size     - Size of storage in bytes
+   */
+  void setTerminalStorage(char *storage, uint16_t size);
+
+  /**
+   * @brief      Pop the oldest captured terminal line
+   * @return     Length of the line, -1 if there is none
+   */
+  int terminalReadLine(char *line, uint16_t size);
+  /**Terminal lines waiting to be read */
+  uint16_t get_terminal_print_lines(void);
+  /**True while a terminal command is queued or running */
+  bool is_terminal_busy(void);
+  /**Terminal lines dropped because the ring was full */
+  uint32_t get_terminal_dropped(void);
+
+  /**
+   * A fault edge: the fault code of a controller changed. The values are the
+   * fault_data fields telemetry carries, sampled with the fault code
+   */
+  struct faultEvent_t
+  {
+    mc_fault_code fault;    // FAULT_CODE_NONE when the fault cleared
+    mc_fault_code previous;
+    uint8_t canId;
+    uint32_t time;          // millis() when the edge was seen
+    float current;
+    float current_in;
+    float voltage;
+    float duty;
+    float rpm;
+    float temp_fet;
+    float temp_motor;
+  };
+
+  typedef void (*faultCallback_t)(void *context, const faultEvent_t &event);
+
+  /**
+   * @brief      Called from faultUpdate() right when the reply with a new fault
+   *             code is decoded, before any other frame is handled
+   */
+  void setFaultCallback(faultCallback_t callback, void *context = NULL);
+
+  /**
+   * @brief      Read the fault code and its context with a short
+   *             COMM_GET_VALUES_SELECTIVE request. Cheap enough to run every
+   *             loop next to the sound update
+   *
+   * @param      canId  - CAN id, 0 for the local device
+   * @return     True if the reply was received
+   */
+  bool faultUpdate(uint8_t canId = 0);
+
+  /**Fault code seen last for the controller */
+  mc_fault_code get_fault_code(uint8_t canId = 0);
+
+  /**
+   * @brief      Copy the fault history, newest first
+   * @return     Number of events copied
+   */
+  uint8_t get_fault_history(faultEvent_t *events, uint8_t max);
+  /**Fault edges seen since start, including the ones no longer in the history */
+  uint32_t get_fault_count(void);
+
+  /**
+   * Setpoints are fire and forget. Each command has one slot: a value set
+   * while the previous one was sent less than VESC_SETPOINT_INTERVAL ms ago
+   * replaces the pending value, so only the newest goes out. Setting one
+   * command drops the values other commands still have pending for the same
+   * controller, the VESC follows the last command anyway. Pending values
+   * are sent from poll() and ahead of any other request, and COMM_ALIVE is
+   * sent from poll() when no setpoint refreshed the VESC timeout for
+   * VESC_ALIVE_INTERVAL ms.
+   *
+   * @param      canId  - CAN id, 0 for the local device
+   */
+  void setCurrent(float current, uint8_t canId = 0);
+  void setBrakeCurrent(float current, uint8_t canId = 0);
+  void setDuty(float duty, uint8_t canId = 0);
+  void setRpm(float rpm, uint8_t canId = 0);
+  /**Current relative to the configured limits, -1.0 to 1.0 */
+  void setCurrentRel(float current, uint8_t canId = 0);
+
+  /**
+   * @brief      Drop pending setpoints and stop the keepalive, the VESC
+   *             releases the motor once its timeout expires
+   */
+  void releaseSetpoints(void);
+
+  /** One COMM_GET_IMU_DATA sample, axes not in mask are 0 */
+  struct imuData_t
+  {
+    uint32_t time;  // millis() when received
+    uint16_t mask;
+    float rpy[3];   // rad
+    float acc[3];   // g
+    float gyro[3];  // deg/s
+    float mag[3];
+    float q[4];
+  };
+
+  /**
+   * @brief      Read the IMU. Only the axes in mask are sent by the VESC
+   *
+   * @param      mask   - imu_mask groups or single axis bits
+   * @param      canId  - CAN id, 0 for the local device
+   * @return     True if a sample was received and added to the history
+   */
+  bool imuUpdate(uint16_t mask = IMU_MASK_RPY | IMU_MASK_ACC, uint8_t canId = 0);
+
+  /**Newest IMU sample */
+  const imuData_t &get_imu_data(void);
+
+  /**
+   * @brief      IMU state at a given time, interpolated between the two history
+   *             samples around it (angles take the short way round). Times
+   *             outside the history return the oldest or newest sample
+   *
+   * @param      time  - millis() timestamp
+   * @return     False if there is no sample yet
+   */
+  bool imuInterpolate(uint32_t time, imuData_t *out);
+
+  /** COMM_GET_DECODED_BALANCE reply, angles in degrees */
+  struct balanceData_t
+  {
+    float pid_output;
+    float pitch_angle;
+    float roll_angle;
+    uint32_t diff_time;     // us between balance loop iterations
+    float motor_current;
+    float debug1;
+    uint16_t state;
+    uint16_t switch_state;
+    float adc1;
+    float adc2;
+    float debug2;
+  };
+
+  /**
+   * @brief      Read the decoded balance state
+   * @param      canId  - CAN id, 0 for the local device
+   * @return     True if the reply was received
+   */
+  bool balanceUpdate(uint8_t canId = 0);
+
+  /**
+   * @brief      balanceUpdate() and soundUpdate() in one burst: both requests
+   *             are sent before the first reply is read, so the two cost one
+   *             round trip. When the VESC does not answer the balance request,
+   *             the next VESC_BALANCE_RETRY bursts only ask for the sound;
+   *             a successful balanceUpdate() asks again at once
+   * @param      canId  - CAN id, 0 for the local device
+   * @return     True if both replies were received
+   */
+  bool balanceSoundUpdate(uint8_t canId = 0);
+
+  /**
+   * @brief      Copy of the last balance state. Safe to call from another task
+   *             while balanceUpdate() runs, a copy torn by an update is retried
+   */
+  balanceData_t get_balance_data(void);
+
 private:
+  /** A float package command: reply length range and the decoder that
+   * stores the reply */
+  struct espCommand_t
+  {
+    uint8_t command;
+    uint8_t minLen;
+    uint8_t maxLen;
+    bool (VescUart::*decode)(uint8_t *message, int lenPay);
+  };
+
+  static const espCommand_t espCommands[];
+
+  /** State of the streaming configuration decoder */
+  struct confDecoder_t
+  {
+    const confField_t *fields;
+    uint8_t count;
+    uint8_t packetId;
+    uint8_t current;
+    uint16_t position;
+    uint8_t signature[4];
+    uint8_t staging[VESC_CONF_MAX_FIELDS][4];
+    bool valid;
+  };
+
+  /** State of the streaming COMM_BMS_GET_VALUES decoder */
+  struct bmsDecoder_t
+  {
+    VescUart *owner;
+    bmsData_t staged;
+    uint8_t step;
+    uint8_t item;
+    uint8_t have;
+    uint8_t field[4];
+    float cellSum;
+    float tempSum;
+    bool valid;
+    // The selected cells and sensors as received. They are copied to the
+    // caller's storage only once the CRC matched
+    int16_t cells[32];
+    uint8_t balance[32];
+    int16_t temps[50];
+  };
+
+  struct bmsStorage_t
+  {
+    float *v_cell;
+    bool *bal_state;
+    uint8_t cellFirst;
+    uint8_t cellCount;
+    float *temps;
+    uint8_t tempFirst;
+    uint8_t tempCount;
+  };
+
   /** Variabel to hold the reference to the Serial object to use for UART */
   Stream *serialPort = NULL;
 
@@ -123,9 +1028,205 @@ private:
   soundData_t engineData;
   advancedData_t settingData;
   uint8_t soundTriggered=0;
+  uint8_t soundFormat=0; // 0 standard, 1 compact asked for, 2 compact negotiated
+  uint8_t soundCompactFails=0; // compact requests in a row without a reply while asked for
+  bool espMismatch=false; // the last reply had the command but did not decode
+  uint8_t protocolVersion=0;
+  uint16_t capabilities=0;
+  bool handshakeDone=false;
   uint8_t enableItemData=0;
 
   bool isVescReady=0; // check float_enable_mask neum 
+  bmsData_t bmsData = {};
+  bmsStorage_t bmsStorage = {};
+
+  static void bmsSink(void *context, const uint8_t *data, uint16_t len);
+  void bmsField(bmsDecoder_t *dec);
+  uint32_t confSignature = 0;
+
+  static void confSink(void *context, const uint8_t *data, uint16_t len);
+  tempLimits_t tempLimits = {};
+  uint8_t tempLimitsPacket = 0; // packet id the cached limits were sent with, 0 if none
+  bool tempLimitsDivide = false;
+  bool tempLimitsForward = false;
+  uint8_t tempLimitsCanId = 0;
+  uint32_t tempLimitsLatency = 0;
+
+  uint8_t *customConfig = NULL;
+  uint16_t customConfigSize = 0;
+  uint16_t customConfigLen = 0;
+  uint32_t customConfigXmlSize = 0;
+  const customField_t *customFields = NULL;
+  uint8_t customIndex[VESC_CUSTOM_CONFIG_INDEX_SIZE]; // field number + 1, 0 is empty
+
+  bool customConfigRead(uint8_t confInd, uint8_t canId);
+  int32_t customConfigXmlLength(uint8_t confInd, uint8_t canId);
+  bool customConfigDownloadXml(VescConfigStorage *storage, uint8_t confInd, uint8_t canId, int32_t size);
+  void customConfigXmlRequest(uint8_t confInd, uint8_t canId, int32_t len, int32_t offset);
+  const customField_t *customConfigFind(const char *name);
+  uint32_t customConfigSignature(void);
+
+  fwCompress_t fwCompress = NULL;
+  uint32_t fwProgress = 0;
+
+  bool firmwareTransfer(Stream *image, uint32_t size, uint16_t expectedCrc, uint32_t resumeOffset, uint8_t canId);
+  bool firmwareErase(uint32_t size, uint8_t canId);
+  void firmwareSendChunk(uint32_t offset, const uint8_t *data, uint16_t len, uint8_t canId);
+  int firmwareAck(uint32_t *offset);
+
+  logField_t logFields[VESC_LOG_MAX_FIELDS];
+  uint8_t logFieldNum = 0;
+  bool logRunning = false;
+  float *logStorage = NULL;
+  uint16_t logStorageSize = 0;
+  uint16_t logCapacity = 0;
+  uint16_t logHead = 0;       // slot of the row being filled
+  uint16_t logRows = 0;
+  uint16_t logUnflushed = 0;
+  uint32_t logOverruns = 0;
+  bool logHeaderWritten = false;
+
+  bool handleUnsolicited(uint8_t *message, int lenPay);
+  void logStart(uint8_t *message, int lenPay);
+  void logConfigField(uint8_t *message, int lenPay);
+  void logData(uint8_t *message, int lenPay, bool f64);
+
+  uint32_t fileProgress = 0;
+  uint32_t fileSize = 0;
+  uint16_t fileCrc = 0;
+
+  int filePathPayload(uint8_t *payload, COMM_PACKET_ID packetId, const char *path, uint8_t canId);
+  void fileReadRequest(const char *path, uint32_t offset, uint8_t canId);
+  bool fileTransfer(const char *path, Stream *in, uint32_t size, uint32_t offset, uint8_t canId);
+  void fileWriteRequest(const char *path, uint32_t offset, uint32_t size, const uint8_t *data, uint16_t len, uint8_t canId);
+  bool fileSimpleCommand(COMM_PACKET_ID packetId, const char *path, uint8_t canId);
+
+  line_ring lispPrint;
+  lispStats_t lispStats = {};
+  uint32_t lispStatsTime = 0;
+  bool lispStatsPolled = false;
+
+  bool lispTransfer(Stream *code, uint32_t size, uint8_t restart, uint8_t canId);
+  void lispStreamChunk(uint32_t offset, uint32_t size, uint8_t restart, const uint8_t *data, uint16_t len, uint8_t canId);
+  void lispDecodeStats(const uint8_t *message, int lenPay);
+
+  struct terminalCmd_t
+  {
+    char cmd[VESC_TERMINAL_CMD_LEN];
+    terminalDone_t done;
+    void *context;
+    bool sync;
+    uint8_t canId;
+  };
+
+  line_ring terminalPrint;
+  terminalCmd_t terminalQueue[VESC_TERMINAL_QUEUE];
+  uint8_t terminalHead = 0;   // running command, or the next one to send
+  uint8_t terminalCount = 0;
+  bool terminalRunning = false;
+  bool terminalSyncDone = false;
+  uint16_t terminalLines = 0;
+  uint32_t terminalStart = 0;
+  uint32_t terminalLastPrint = 0;
+
+  void terminalCapture(const uint8_t *text, int len);
+  void terminalService(void);
+
+  struct faultDevice_t
+  {
+    uint8_t canId;
+    bool used;
+    mc_fault_code fault;
+  };
+
+  faultCallback_t faultCallback = NULL;
+  void *faultContext = NULL;
+  faultDevice_t faultDevices[VESC_FAULT_DEVICES] = {};
+  faultEvent_t faultHistory[VESC_FAULT_HISTORY];
+  uint8_t faultHead = 0;      // next slot written
+  uint32_t faultCount = 0;
+
+  faultDevice_t *faultDevice(uint8_t canId);
+  void faultDecode(const uint8_t *message, int lenPay, uint8_t canId);
+
+  enum
+  {
+    SETPOINT_CURRENT = 0,
+    SETPOINT_CURRENT_BRAKE,
+    SETPOINT_DUTY,
+    SETPOINT_RPM,
+    SETPOINT_CURRENT_REL,
+    SETPOINT_COUNT
+  };
+
+  struct setpoint_t
+  {
+    float value;
+    uint8_t canId;
+    bool pending;
+    uint32_t lastSent;
+  };
+
+  setpoint_t setpoints[SETPOINT_COUNT] = {};
+  uint8_t setpointPending = 0; // bit per slot
+  bool setpointSending = false;
+  bool aliveActive = false;
+  uint8_t aliveCanId = 0;
+  uint32_t aliveLast = 0;      // last frame that refreshed the VESC timeout
+
+  void setpointSet(uint8_t slot, float value, uint8_t canId);
+  void setpointSend(uint8_t slot);
+  void setpointService(bool all);
+
+  imuData_t imuHistory[VESC_IMU_HISTORY] = {};
+  uint8_t imuHead = 0;        // slot of the newest sample
+  uint8_t imuCount = 0;
+
+  balanceData_t balanceData = {};
+  volatile uint32_t balanceSeq = 0; // odd while balanceData is written
+
+  uint16_t balanceSkip = 0;   // bursts left that do not ask for the balance state
+
+  void balanceRequest(uint8_t canId);
+  bool balanceDecode(uint8_t *message, int lenPay);
+
+  Print *captureLog = NULL;
+  uint32_t captureLast = 0;   // micros() of the previous record
+
+  /** readBytes() / write() on the serial port, recorded when capturing */
+  size_t uartRead(uint8_t *buffer, size_t len);
+  void uartWrite(const uint8_t *buffer, size_t len);
+  void captureChunk(uint8_t direction, const uint8_t *data, size_t len);
+
+  /** Decoders of the espCommands entries, each stores its own reply */
+  bool readyDecode(uint8_t *message, int lenPay);
+  bool soundDecode(uint8_t *message, int lenPay);
+  bool advancedDecode(uint8_t *message, int lenPay);
+  bool soundTriggeredDecode(uint8_t *message, int lenPay);
+  bool enableItemDecode(uint8_t *message, int lenPay);
+  bool bundleDecode(uint8_t *message, int lenPay);
+  bool soundDecodeCompact(uint8_t *message, int lenPay);
+  /** Track whether the package answers the compact sound frame */
+  void soundCompactResult(bool answered);
+
+  /**
+   * @brief      Length check of a float package reply: within minLen..maxLen
+   *             for protocol 0, newer protocols may append fields
+   */
+  bool replyLengthOk(int lenPay, int minLen, int maxLen);
+
+  /**
+   * @brief      Send a float package command and decode its reply with the
+   *             decoder from espCommands
+   * @return     True if the reply matched the command and was decoded
+   */
+  bool espRequest(esp_commands command);
+  void espSend(esp_commands command, uint8_t canId);
+  /** Check a reply against the espCommands entry of command and decode it */
+  bool espDecode(esp_commands command, uint8_t *message, int lenPay);
+
+  bool sendTempLimits(COMM_PACKET_ID packetId, const tempLimits_t &limits, bool forwardCan, bool store, uint8_t canId, bool divide);
+  bool getConfiguration(COMM_PACKET_ID packetId, const confField_t *fields, uint8_t count, uint32_t signature, uint8_t canId);
   /**
    * @brief      Packs the payload and sends it over Serial
    *
@@ -134,6 +1235,8 @@ private:
    * @return     The number of bytes send
    */
   int packSendPayload(uint8_t *payload, int lenPay);
+  /**Same, the frame payload is head followed by payload */
+  int packSendPayload(uint8_t *head, int lenHead, uint8_t *payload, int lenPay);
 
   /**
    * @brief      Receives the message over Serial
@@ -143,6 +1246,56 @@ private:
    */
   int receiveUartMessage(uint8_t *payloadReceived);
 
+  /**
+   * @brief      Receives one message over Serial, receiveUartMessage() without
+   *             the handling of unsolicited frames
+   *
+   * @param      payloadReceived  - The received payload as a unit8_t Array
+   * @return     The number of bytes receeived within the payload
+   */
+  int receiveUartFrame(uint8_t *payloadReceived);
+
+  /**
+   * @brief      Receives a message of any length (start byte 2 or 3) without
+   *             buffering it, the payload is passed to sink in chunks while the
+   *             CRC is computed on the fly. Frames with another packet id are
+   *             handled as unsolicited ones and skipped
+   *
+   * @param      packetId - First payload byte of the expected reply
+   * @param      sink     - Called with consecutive payload chunks
+   * @param      context  - Passed back to sink
+   * @return     The payload length if the CRC matched, else 0
+   */
+  int receiveUartStream(uint8_t packetId, payloadSink_t sink, void *context);
+
+  /** Context of copySink(): checks the first expectLen payload bytes against
+   * expect and copies the rest to dst */
+  struct copySink_t
+  {
+    const uint8_t *expect;
+    uint8_t expectLen;
+    uint8_t *dst;
+    uint16_t size;
+    uint16_t pos;
+    bool valid;
+  };
+
+  static void copySink(void *context, const uint8_t *data, uint16_t len);
+
+  /**
+   * @brief      Drop everything received during one timeout period, used after
+   *             a failed pipelined transfer so late replies are not mistaken
+   *             for the next answer
+   */
+  void drainUart(void);
+
+  /**
+   * @brief      Drop the complete frames already received before a request is
+   *             sent: late or repeated replies to earlier requests. Frames the
+   *             VESC sends on its own are handled as usual. Waits for nothing.
+   */
+  void dropStale(void);
+
   /**
    * @brief      Verifies the message (CRC-16) and extracts the payload
    *
@@ -153,14 +1306,6 @@ private:
    */
   bool unpackPayload(uint8_t *message, int lenMes, uint8_t *payload);
 
-  /**
-   * @brief      Extracts the data from the received payload
-   *
-   * @param      message  - The payload to extract data from
-   * @return     True if the process was a success
-   */
-  bool processReadPacket(uint8_t *message, int lenPay);
-
   /**
    * @brief      Help Function to print uint8_t array over Serial for Debug
    *
@@ -208,3 +208,32 @@ void buffer_append_bool(uint8_t *buffer,bool value, int32_t *index) {
 	}
 
 }
+
+/*
+ * Zigzag varint: small magnitudes of either sign take few bytes, 7 bits per
+ * byte with the high bit set on all but the last. Values up to +-8191 take
+ * two bytes, +-1048575 three.
+ */
+void buffer_append_varint(uint8_t* buffer, int32_t number, int32_t *index) {
+	uint32_t zz = ((uint32_t)number << 1) ^ (uint32_t)(number >> 31);
+
+	while (zz >= 0x80) {
+		buffer[(*index)++] = (uint8_t)(zz | 0x80);
+		zz >>= 7;
+	}
+	buffer[(*index)++] = (uint8_t)zz;
+}
+
+int32_t buffer_get_varint(const uint8_t *buffer, int32_t len, int32_t *index) {
+	uint32_t zz = 0;
+
+	for (uint8_t shift = 0; shift < 35 && *index < len; shift += 7) {
+		uint8_t b = buffer[(*index)++];
+		zz |= (uint32_t)(b & 0x7F) << shift;
+		if (!(b & 0x80)) {
+			break;
+		}
+	}
+
+	return (int32_t)(zz >> 1) ^ -(int32_t)(zz & 1);
+}
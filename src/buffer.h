@@ -38,5 +38,7 @@ float buffer_get_float32(const uint8_t *buffer, float scale, int32_t *index);
 float buffer_get_float32_auto(const uint8_t *buffer, int32_t *index);
 bool buffer_get_bool(const uint8_t *buffer, int32_t *index);
 void buffer_append_bool(uint8_t *buffer,bool value, int32_t *index);
+void buffer_append_varint(uint8_t* buffer, int32_t number, int32_t *index);
+int32_t buffer_get_varint(const uint8_t *buffer, int32_t len, int32_t *index);
 
 #endif /* BUFFER_H_ */
@@ -26,5 +26,6 @@
  * Functions
  */
 unsigned short crc16(unsigned char *buf, unsigned int len);
+unsigned short crc16_continue(unsigned short cksum, const unsigned char *buf, unsigned int len);
 
 #endif /* CRC_H_ */
@@ -0,0 +1,134 @@
+#ifndef VESC_HOST_ARDUINO_H_
+#define VESC_HOST_ARDUINO_H_
+
+/*
+ * Minimal Arduino API to build the library on a POSIX host (tests, tools,
+ * simulators). Add src/host to the include path ahead of nothing else; on the
+ * target the real core provides Arduino.h and this directory is not used.
+ *
+ * Time comes from a replaceable clock, see VescHost.h for a virtual one.
+ */
+
+#ifdef ARDUINO
+#error "src/host is for host builds only"
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+// Clock used by millis(), micros() and delay()
+struct vesc_host_clock_t
+{
+	uint64_t (*now_us)(void);
+	void (*sleep_us)(uint64_t us);
+};
+
+inline uint64_t vesc_host_steady_us(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+inline void vesc_host_steady_sleep(uint64_t us)
+{
+	struct timespec ts;
+	ts.tv_sec = us / 1000000;
+	ts.tv_nsec = (us % 1000000) * 1000;
+	nanosleep(&ts, NULL);
+}
+
+inline vesc_host_clock_t &vesc_host_clock(void)
+{
+	static vesc_host_clock_t clock = {vesc_host_steady_us, vesc_host_steady_sleep};
+	return clock;
+}
+
+inline unsigned long millis(void)
+{
+	return (unsigned long)(uint32_t)(vesc_host_clock().now_us() / 1000);
+}
+
+inline unsigned long micros(void)
+{
+	return (unsigned long)(uint32_t)vesc_host_clock().now_us();
+}
+
+inline void delay(unsigned long ms)
+{
+	vesc_host_clock().sleep_us((uint64_t)ms * 1000);
+}
+
+inline void yield(void)
+{
+}
+
+class Print
+{
+public:
+	virtual ~Print() {}
+	virtual size_t write(uint8_t c) = 0;
+
+	virtual size_t write(const uint8_t *buffer, size_t size)
+	{
+		size_t n = 0;
+		while (size--)
+			n += write(*buffer++);
+		return n;
+	}
+
+	size_t write(const char *str) { return write((const uint8_t *)str, strlen(str)); }
+
+	size_t print(const char *str) { return write(str); }
+	size_t print(char c) { return write((uint8_t)c); }
+	size_t print(int value) { return printf("%d", value); }
+	size_t print(unsigned int value) { return printf("%u", value); }
+	size_t print(long value) { return printf("%ld", value); }
+	size_t print(unsigned long value) { return printf("%lu", value); }
+	size_t print(double value) { return printf("%.2f", value); }
+
+	size_t println(void) { return write("\r\n"); }
+	template <typename T>
+	size_t println(T value) { return print(value) + println(); }
+
+	__attribute__((format(printf, 2, 3))) size_t printf(const char *format, ...)
+	{
+		char buffer[256];
+		va_list args;
+		va_start(args, format);
+		int len = vsnprintf(buffer, sizeof(buffer), format, args);
+		va_end(args);
+		if (len < 0)
+			return 0;
+		if ((size_t)len >= sizeof(buffer))
+			len = sizeof(buffer) - 1;
+		return write((const uint8_t *)buffer, len);
+	}
+};
+
+class Stream : public Print
+{
+public:
+	virtual int available(void) = 0;
+	virtual int read(void) = 0;
+	virtual int peek(void) = 0;
+
+	// Returns what is there, host streams do not wait like Arduino's timedRead()
+	virtual size_t readBytes(uint8_t *buffer, size_t length)
+	{
+		size_t n = 0;
+		while (n < length && available() > 0)
+			buffer[n++] = (uint8_t)read();
+		return n;
+	}
+
+	size_t readBytes(char *buffer, size_t length) { return readBytes((uint8_t *)buffer, length); }
+};
+
+#endif /* VESC_HOST_ARDUINO_H_ */
@@ -0,0 +1,286 @@
+#ifndef VESC_HOST_H_
+#define VESC_HOST_H_
+
+/*
+ * Streams and clocks for host builds:
+ *
+ *   FdStream        Stream over a POSIX file descriptor (pipe, pty, socket)
+ *   LoopbackStream  in-memory stream, two of them connected form a link
+ *   RepeatStream    reads one recorded frame over and over, drops what is written
+ *   VirtualClock    replaces the system clock behind millis() / micros()
+ *
+ * Stream::readBytes() on the host returns what is available at once, it does
+ * not wait up to setTimeout() for the rest like Arduino's. VescUart only asks
+ * for bytes available() reported, so it behaves the same on both; a Stream
+ * given to firmwareUpload() or fileWrite() must have the whole chunk ready,
+ * as a file or a LoopbackStream has.
+ */
+
+#include "Arduino.h"
+#include <errno.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+
+class FdStream : public Stream
+{
+public:
+	explicit FdStream(int fd = -1) : fd(fd) {}
+
+	void setFd(int descriptor) { fd = descriptor; }
+	int getFd(void) const { return fd; }
+
+	int available(void) override
+	{
+		int n = 0;
+		if (fd < 0 || ioctl(fd, FIONREAD, &n) < 0)
+			return 0;
+		return n;
+	}
+
+	int read(void) override
+	{
+		uint8_t c;
+		return readBytes(&c, 1) == 1 ? c : -1;
+	}
+
+	int peek(void) override
+	{
+		return -1; // not needed by VescUart
+	}
+
+	// One system call for the whole block
+	size_t readBytes(uint8_t *buffer, size_t length) override
+	{
+		if (fd < 0)
+			return 0;
+		ssize_t n;
+		do
+			n = ::read(fd, buffer, length);
+		while (n < 0 && errno == EINTR);
+		return n > 0 ? (size_t)n : 0;
+	}
+
+	size_t write(uint8_t c) override
+	{
+		return write(&c, 1);
+	}
+
+	size_t write(const uint8_t *buffer, size_t size) override
+	{
+		size_t done = 0;
+		while (fd >= 0 && done < size)
+		{
+			ssize_t n = ::write(fd, buffer + done, size - done);
+			if (n < 0 && errno == EINTR)
+				continue;
+			if (n <= 0)
+				break;
+			done += n;
+		}
+		return done;
+	}
+
+	using Stream::readBytes;
+	using Print::write;
+
+private:
+	int fd;
+};
+
+/*
+ * Bytes written to a LoopbackStream are read from its peer. A single stream
+ * without a peer reads back what it wrote.
+ */
+template <size_t Size = 4096>
+class LoopbackStream : public Stream
+{
+public:
+	LoopbackStream() : peer(this), head(0), tail(0), used(0), dropped(0) {}
+
+	void connect(LoopbackStream &other)
+	{
+		peer = &other;
+		other.peer = this;
+	}
+
+	int available(void) override { return used; }
+
+	int read(void) override
+	{
+		if (used == 0)
+			return -1;
+		uint8_t c = buffer[tail];
+		tail = (tail + 1) % Size;
+		used--;
+		return c;
+	}
+
+	int peek(void) override { return used > 0 ? buffer[tail] : -1; }
+
+	size_t readBytes(uint8_t *out, size_t length) override
+	{
+		size_t n = 0;
+		while (n < length && used > 0)
+		{
+			size_t run = Size - tail;
+			if (run > used)
+				run = used;
+			if (run > length - n)
+				run = length - n;
+			memcpy(out + n, buffer + tail, run);
+			tail = (tail + run) % Size;
+			used -= run;
+			n += run;
+		}
+		return n;
+	}
+
+	size_t write(uint8_t c) override { return peer->push(&c, 1); }
+	size_t write(const uint8_t *data, size_t size) override { return peer->push(data, size); }
+
+	/** Bytes lost because the receiving side was full */
+	uint32_t get_dropped(void) const { return dropped; }
+
+	using Stream::readBytes;
+	using Print::write;
+
+private:
+	size_t push(const uint8_t *data, size_t size)
+	{
+		size_t n = 0;
+		for (; n < size && used < Size; n++)
+		{
+			buffer[head] = data[n];
+			head = (head + 1) % Size;
+			used++;
+		}
+		dropped += size - n;
+		return n;
+	}
+
+	LoopbackStream *peer;
+	uint8_t buffer[Size];
+	size_t head;
+	size_t tail;
+	size_t used;
+	uint32_t dropped;
+};
+
+/*
+ * Answers every request with the same recorded bytes, with no peer to run:
+ * benchmarks of the request paths measure the library alone with it. By
+ * default the bytes repeat for as long as they are read; onRequest plays one
+ * copy per write, as a VESC would, so nothing is waiting before a request.
+ */
+class RepeatStream : public Stream
+{
+public:
+	RepeatStream() : length(0), pos(0), onRequest(false), requested(false) {}
+
+	void setFrame(const uint8_t *data, size_t len, bool onRequest = false)
+	{
+		if (len > sizeof(frame))
+			len = sizeof(frame);
+		memcpy(frame, data, len);
+		length = len;
+		pos = onRequest ? len : 0;
+		this->onRequest = onRequest;
+		requested = false;
+	}
+
+	int available(void) override
+	{
+		if (pos == length)
+		{
+			if (onRequest && !requested)
+				return 0;
+			pos = 0;
+			requested = false;
+		}
+		return length - pos;
+	}
+
+	int read(void) override { return available() > 0 ? frame[pos++] : -1; }
+	int peek(void) override { return available() > 0 ? frame[pos] : -1; }
+
+	size_t readBytes(uint8_t *out, size_t len) override
+	{
+		size_t n = (size_t)available();
+		if (n > len)
+			n = len;
+		memcpy(out, frame + pos, n);
+		pos += n;
+		return n;
+	}
+
+	size_t write(uint8_t c) override
+	{
+		(void)c;
+		requested = true;
+		return 1;
+	}
+	size_t write(const uint8_t *data, size_t size) override
+	{
+		(void)data;
+		requested = true;
+		return size;
+	}
+
+	using Stream::readBytes;
+	using Print::write;
+
+private:
+	uint8_t frame[512];
+	size_t length;
+	size_t pos;
+	bool onRequest;
+	bool requested; // a request came in since the last copy started
+};
+
+/*
+ * Deterministic time. Every reading of the clock moves it on by step, so busy
+ * waits in VescUart still reach their timeouts; delay() moves it without
+ * sleeping.
+ */
+class VirtualClock
+{
+public:
+	static void install(uint64_t start_us = 0, uint64_t step_us = 1)
+	{
+		now() = start_us;
+		step() = step_us;
+		vesc_host_clock().now_us = read;
+		vesc_host_clock().sleep_us = advance;
+	}
+
+	static void uninstall(void)
+	{
+		vesc_host_clock().now_us = vesc_host_steady_us;
+		vesc_host_clock().sleep_us = vesc_host_steady_sleep;
+	}
+
+	static void advance(uint64_t us) { now() += us; }
+	static void setStep(uint64_t us) { step() = us; }
+
+	static uint64_t read(void)
+	{
+		uint64_t t = now();
+		now() += step();
+		return t;
+	}
+
+private:
+	static uint64_t &now(void)
+	{
+		static uint64_t value = 0;
+		return value;
+	}
+
+	static uint64_t &step(void)
+	{
+		static uint64_t value = 1;
+		return value;
+	}
+};
+
+#endif /* VESC_HOST_H_ */
@@ -0,0 +1,189 @@
+#ifndef VESC_LINUX_SERIAL_H_
+#define VESC_LINUX_SERIAL_H_
+
+/*
+ * Linux serial port for host builds (USB serial adapters, UARTs of single
+ * board computers, ptys):
+ *
+ *   - raw 8N1 through termios2, so any baud rate the driver accepts works
+ *   - available() waits on epoll for up to pollMs when nothing is buffered
+ *     and the last call found nothing either, so the receive loops of
+ *     VescUart sleep there instead of spinning, while a single check does not
+ *   - readBytes() is a single read(2)
+ *
+ *   LinuxSerial port;
+ *   port.begin("/dev/ttyUSB0", 115200);
+ *   vesc.setSerialPort(&port);
+ *
+ * openPty() attaches the port to a new pty and returns the other side, which
+ * a simulated VESC can serve without any hardware.
+ */
+
+#ifndef __linux__
+#error "VescLinuxSerial.h needs Linux"
+#endif
+
+#include "VescHost.h"
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <asm/termbits.h> // termios2, <termios.h> would clash with it
+
+class LinuxSerial : public FdStream
+{
+public:
+	LinuxSerial() : epollFd(-1), pollMs(1), idle(false) {}
+	~LinuxSerial() { end(); }
+
+	/**
+	 * Open and configure a serial device
+	 * @return false if it cannot be opened or does not take the settings
+	 */
+	bool begin(const char *path, uint32_t baud)
+	{
+		end();
+		int fd = open(path, O_RDWR | O_NOCTTY | O_CLOEXEC);
+		if (fd < 0)
+			return false;
+		if (!attach(fd, baud))
+		{
+			close(fd);
+			return false;
+		}
+		return true;
+	}
+
+	/** Use an already open descriptor, e.g. one side of a pty */
+	bool attach(int fd, uint32_t baud)
+	{
+		struct termios2 tio;
+		if (ioctl(fd, TCGETS2, &tio) < 0)
+			return false;
+
+		// Raw 8N1, reads return what is there (VMIN = VTIME = 0)
+		tio.c_iflag &= ~(IGNBRK | BRKINT | PARMRK | ISTRIP | INLCR | IGNCR | ICRNL | IXON | IXOFF | IXANY);
+		tio.c_oflag &= ~OPOST;
+		tio.c_lflag &= ~(ECHO | ECHONL | ICANON | ISIG | IEXTEN);
+		tio.c_cflag &= ~(CSIZE | PARENB | CSTOPB | CRTSCTS | CBAUD);
+		tio.c_cflag |= CS8 | CREAD | CLOCAL | BOTHER;
+		tio.c_ispeed = baud;
+		tio.c_ospeed = baud;
+		tio.c_cc[VMIN] = 0;
+		tio.c_cc[VTIME] = 0;
+
+		if (ioctl(fd, TCSETS2, &tio) < 0)
+			return false;
+
+		epollFd = epoll_create1(EPOLL_CLOEXEC);
+		if (epollFd < 0)
+			return false;
+
+		struct epoll_event ev;
+		memset(&ev, 0, sizeof(ev));
+		ev.events = EPOLLIN;
+		ev.data.fd = fd;
+		if (epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &ev) < 0)
+		{
+			close(epollFd);
+			epollFd = -1;
+			return false;
+		}
+
+		ioctl(fd, TCFLSH, TCIOFLUSH);
+		setFd(fd);
+		return true;
+	}
+
+	void end(void)
+	{
+		if (epollFd >= 0)
+			close(epollFd);
+		if (getFd() >= 0)
+			close(getFd());
+		epollFd = -1;
+		setFd(-1);
+	}
+
+	/** Longest time available() sleeps when no byte is waiting, 0 never sleeps */
+	void setPollInterval(int ms) { pollMs = ms; }
+	int getPollInterval(void) const { return pollMs; }
+
+	/**
+	 * Wait until input arrives
+	 * @return true if bytes are waiting
+	 */
+	bool waitReadable(int timeout_ms)
+	{
+		if (epollFd < 0)
+			return false;
+
+		struct epoll_event ev;
+		int n;
+		do
+			n = epoll_wait(epollFd, &ev, 1, timeout_ms);
+		while (n < 0 && errno == EINTR);
+		return n > 0;
+	}
+
+	int available(void) override
+	{
+		int n = FdStream::available();
+		if (n == 0 && idle && pollMs > 0 && waitReadable(pollMs))
+			n = FdStream::available();
+		idle = n == 0;
+		return n;
+	}
+
+	/** Block until everything written has left the port */
+	void flush(void)
+	{
+		if (getFd() >= 0)
+			ioctl(getFd(), TCSBRK, 1);
+	}
+
+	/**
+	 * Attach to the slave side of a new pty
+	 * @return the master descriptor for the other end, -1 on failure
+	 */
+	int openPty(uint32_t baud = 115200)
+	{
+		end();
+
+		// posix_openpt() rather than openpty(), <pty.h> pulls in <termios.h>
+		int master = posix_openpt(O_RDWR | O_NOCTTY | O_CLOEXEC);
+		if (master < 0)
+			return -1;
+
+		const char *name = (grantpt(master) == 0 && unlockpt(master) == 0) ? ptsname(master) : NULL;
+		int slave = name != NULL ? open(name, O_RDWR | O_NOCTTY | O_CLOEXEC) : -1;
+		if (slave < 0)
+		{
+			close(master);
+			return -1;
+		}
+
+		// The master side must not echo or translate either
+		struct termios2 tio;
+		if (ioctl(master, TCGETS2, &tio) == 0)
+		{
+			tio.c_iflag = 0;
+			tio.c_oflag = 0;
+			tio.c_lflag = 0;
+			ioctl(master, TCSETS2, &tio);
+		}
+
+		if (!attach(slave, baud))
+		{
+			close(master);
+			close(slave);
+			return -1;
+		}
+		return master;
+	}
+
+private:
+	int epollFd;
+	int pollMs;
+	bool idle; // the last available() found nothing
+};
+
+#endif /* VESC_LINUX_SERIAL_H_ */
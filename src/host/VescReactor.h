@@ -0,0 +1,333 @@
+#ifndef VESC_REACTOR_H_
+#define VESC_REACTOR_H_
+
+/*
+ * One thread serving many VescUart instances, each on its own LinuxSerial.
+ * The reactor waits on all port descriptors with a single epoll set and
+ *
+ *   - calls poll() of every port on each turn: input that arrived (log rows,
+ *     prints, ...) is handled, and queued setpoints, the COMM_ALIVE keepalive
+ *     and terminal commands go out even on a port that stays quiet
+ *   - runs the tasks scheduled for each port when they are due
+ *
+ * A turn waits at most VESC_SETPOINT_INTERVAL ms, the shortest period of the
+ * poll() services.
+ *
+ * Input is read off a port as soon as epoll reports it and kept in a
+ * VescReactorPort between the port and its VescUart. poll() only sees the
+ * complete frames in there, so a frame that arrived in part waits for the
+ * rest in the buffer while the reactor goes back to epoll.
+ *
+ * Tasks use the normal blocking VescUart calls, so a task holds its reactor
+ * for one round trip. VescReactorPool spreads the ports over several reactor
+ * threads when that adds up to too much for one.
+ *
+ *   VescReactor reactor;
+ *   std::atomic<bool> stop(false);
+ *   int p = reactor.add(&vesc, &port);
+ *   reactor.schedule(p, readSound, NULL, 20);
+ *   reactor.run(&stop);
+ */
+
+#include "VescLinuxSerial.h"
+#include "VescUart.h"
+#include <string.h>
+#include <atomic>
+#include <deque>
+#include <thread>
+#include <vector>
+
+// Input kept per port, at least the longest frame poll() has to take
+#ifndef VESC_REACTOR_BUFFER
+#define VESC_REACTOR_BUFFER 2048
+#endif
+
+/*
+ * Stream the reactor puts between a LinuxSerial and its VescUart. While
+ * gated, only the bytes of complete frames are available and nothing is read
+ * from the port; otherwise the buffer is read first, then the port as usual.
+ */
+class VescReactorPort : public Stream
+{
+public:
+	explicit VescReactorPort(LinuxSerial *port) : port(port), head(0), tail(0), gateEnd(0), gated(false) {}
+
+	VescReactorPort(const VescReactorPort &) = delete;
+	VescReactorPort &operator=(const VescReactorPort &) = delete;
+
+	/** Move what the port has into the buffer, without waiting */
+	void fill(void)
+	{
+		if (head > 0)
+		{
+			memmove(buffer, buffer + head, tail - head);
+			tail -= head;
+			head = 0;
+		}
+
+		int n = port->FdStream::available();
+		if (n <= 0 || tail == sizeof(buffer))
+			return;
+		size_t room = sizeof(buffer) - tail;
+		tail += port->readBytes(buffer + tail, (size_t)n < room ? (size_t)n : room);
+	}
+
+	/** Bytes up to the end of the last complete frame in the buffer */
+	size_t complete(void) const
+	{
+		size_t pos = head;
+		while (pos < tail)
+		{
+			size_t total;
+			if (buffer[pos] == 2 && tail - pos >= 2)
+				total = buffer[pos + 1] + 5;
+			else if (buffer[pos] == 3 && tail - pos >= 3)
+				total = (buffer[pos + 1] << 8 | buffer[pos + 2]) + 6;
+			else if (buffer[pos] == 2 || buffer[pos] == 3)
+				break;
+			else
+				total = 1; // not a start byte, the parser drops it at once
+
+			if (tail - pos < total)
+				break;
+			pos += total;
+		}
+		return pos - head;
+	}
+
+	/** True when the buffer is full without a complete frame in it */
+	bool stuck(void) const { return head == 0 && tail == sizeof(buffer) && complete() == 0; }
+
+	void setGated(bool on)
+	{
+		gated = on;
+		gateEnd = head + complete();
+	}
+
+	int available(void) override
+	{
+		if (gated)
+			return gateEnd - head;
+		if (tail > head)
+			return tail - head;
+		return port->available();
+	}
+
+	int read(void) override
+	{
+		if ((gated ? gateEnd : tail) > head)
+			return buffer[head++];
+		return gated ? -1 : port->read();
+	}
+
+	int peek(void) override
+	{
+		if ((gated ? gateEnd : tail) > head)
+			return buffer[head];
+		return gated ? -1 : port->peek();
+	}
+
+	size_t readBytes(uint8_t *out, size_t length) override
+	{
+		size_t n = (gated ? gateEnd : tail) - head;
+		if (n == 0)
+			return gated ? 0 : port->readBytes(out, length);
+		if (n > length)
+			n = length;
+		memcpy(out, buffer + head, n);
+		head += n;
+		return n;
+	}
+
+	size_t write(uint8_t c) override { return port->write(c); }
+	size_t write(const uint8_t *data, size_t size) override { return port->write(data, size); }
+
+	using Stream::readBytes;
+	using Print::write;
+
+private:
+	LinuxSerial *port;
+	uint8_t buffer[VESC_REACTOR_BUFFER];
+	size_t head;
+	size_t tail;
+	size_t gateEnd;	// end of the complete frames while gated
+	bool gated;
+};
+
+class VescReactor
+{
+public:
+	typedef void (*task_t)(VescUart &vesc, void *context);
+
+	VescReactor() : epollFd(epoll_create1(EPOLL_CLOEXEC)) {}
+	~VescReactor()
+	{
+		if (epollFd >= 0)
+			close(epollFd);
+	}
+
+	VescReactor(const VescReactor &) = delete;
+	VescReactor &operator=(const VescReactor &) = delete;
+
+	/**
+	 * Serve a VescUart on port. Its serial port is set to the reactor's
+	 * VescReactorPort in front of port, leave it that way while served
+	 * @return port number for schedule(), -1 on failure
+	 */
+	int add(VescUart *vesc, LinuxSerial *port)
+	{
+		int index = ports.size();
+		struct epoll_event ev;
+		memset(&ev, 0, sizeof(ev));
+		ev.events = EPOLLIN;
+		ev.data.u32 = index;
+		if (epollFd < 0 || port->getFd() < 0 || epoll_ctl(epollFd, EPOLL_CTL_ADD, port->getFd(), &ev) < 0)
+			return -1;
+
+		ports.emplace_back(vesc, port);
+		vesc->setSerialPort(&ports.back().input);
+		return index;
+	}
+
+	/** Run task every interval_ms for the port, the first run is at once */
+	bool schedule(int port, task_t task, void *context, uint32_t interval_ms)
+	{
+		if (port < 0 || port >= (int)ports.size())
+			return false;
+
+		task_entry_t entry = {port, task, context, interval_ms, (uint32_t)millis()};
+		tasks.push_back(entry);
+		return true;
+	}
+
+	/** Handle the input that is there and the tasks that are due, waiting at most timeout_ms for either */
+	void runOnce(int timeout_ms)
+	{
+		// poll() has setpoints and the keepalive to send on time
+		int service = VESC_SETPOINT_INTERVAL < VESC_ALIVE_INTERVAL ? VESC_SETPOINT_INTERVAL : VESC_ALIVE_INTERVAL;
+		if (timeout_ms < 0 || timeout_ms > service)
+			timeout_ms = service;
+
+		uint32_t now = millis();
+		for (size_t i = 0; i < tasks.size(); i++)
+		{
+			int32_t left = (int32_t)(tasks[i].due - now);
+			if (left < 0)
+				left = 0;
+			if (left < timeout_ms)
+				timeout_ms = left;
+		}
+
+		struct epoll_event events[16];
+		int n;
+		do
+			n = epoll_wait(epollFd, events, 16, timeout_ms);
+		while (n < 0 && errno == EINTR);
+
+		for (int i = 0; i < n; i++)
+			ports[events[i].data.u32].input.fill();
+
+		for (size_t i = 0; i < ports.size(); i++)
+		{
+			port_t &p = ports[i];
+
+			// Complete frames only, the rest of a split frame stays buffered.
+			// A frame longer than the buffer is read from the port directly.
+			p.input.setGated(!p.input.stuck());
+			p.vesc->poll();
+			p.input.setGated(false);
+		}
+
+		now = millis();
+		for (size_t i = 0; i < tasks.size(); i++)
+		{
+			task_entry_t &t = tasks[i];
+			if ((int32_t)(now - t.due) < 0)
+				continue;
+
+			t.task(*ports[t.port].vesc, t.context);
+
+			// Keep the schedule, but do not try to catch up after a stall
+			t.due += t.interval;
+			if ((int32_t)(millis() - t.due) > 0)
+				t.due = millis() + t.interval;
+		}
+	}
+
+	/** Loop until *stop is set, from this or any other thread */
+	void run(const std::atomic<bool> *stop)
+	{
+		while (!stop->load())
+			runOnce(100);
+	}
+
+	size_t get_port_count(void) const { return ports.size(); }
+
+private:
+	struct port_t
+	{
+		VescUart *vesc;
+		VescReactorPort input;
+
+		port_t(VescUart *vesc, LinuxSerial *port) : vesc(vesc), input(port) {}
+	};
+
+	struct task_entry_t
+	{
+		int port;
+		task_t task;
+		void *context;
+		uint32_t interval;
+		uint32_t due;
+	};
+
+	int epollFd;
+	std::deque<port_t> ports; // stays in place, VescUart points at input
+	std::vector<task_entry_t> tasks;
+};
+
+/*
+ * Several reactors, one thread each. Ports are dealt out round robin, a port
+ * and its tasks always stay on the same thread.
+ */
+class VescReactorPool
+{
+public:
+	explicit VescReactorPool(int threads) : reactors(threads > 0 ? threads : 1), next(0) {}
+
+	/** @return handle for schedule(), -1 on failure */
+	int add(VescUart *vesc, LinuxSerial *port)
+	{
+		int shard = next++ % reactors.size();
+		int local = reactors[shard].add(vesc, port);
+		if (local < 0)
+			return -1;
+		handles.push_back(std::make_pair(shard, local));
+		return handles.size() - 1;
+	}
+
+	bool schedule(int handle, VescReactor::task_t task, void *context, uint32_t interval_ms)
+	{
+		if (handle < 0 || handle >= (int)handles.size())
+			return false;
+		return reactors[handles[handle].first].schedule(handles[handle].second, task, context, interval_ms);
+	}
+
+	/** Run every reactor on its own thread until *stop is set */
+	void run(const std::atomic<bool> *stop)
+	{
+		std::vector<std::thread> threads;
+		for (size_t i = 1; i < reactors.size(); i++)
+			threads.push_back(std::thread(&VescReactor::run, &reactors[i], stop));
+		reactors[0].run(stop);
+		for (size_t i = 0; i < threads.size(); i++)
+			threads[i].join();
+	}
+
+private:
+	std::vector<VescReactor> reactors;
+	std::vector<std::pair<int, int> > handles;
+	size_t next;
+};
+
+#endif /* VESC_REACTOR_H_ */
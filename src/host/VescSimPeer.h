@@ -0,0 +1,515 @@
+#ifndef VESC_SIM_PEER_H_
+#define VESC_SIM_PEER_H_
+
+/*
+ * Simulated VESC with the float package for host builds. It answers
+ *
+ *   COMM_CUSTOM_APP_DATA  every esp_commands value, as the package does
+ *   COMM_GET_VALUES       and COMM_GET_VALUES_SELECTIVE
+ *   COMM_FORWARD_CAN      the forwarded request, as if the CAN device replied
+ *
+ * and passes everything else to the handler given to setHandler(), if any, or
+ * ignores it like setpoints and COMM_ALIVE. Replies leave
+ * after the request has crossed the wire, the processing delay and their own
+ * wire time at the configured baud rate. Time is read from the host clock,
+ * with VirtualClock the whole exchange is deterministic.
+ *
+ * In memory, VescUart talks to port():
+ *
+ *   VescSimPeer peer;
+ *   peer.sound.erpm = 3000;
+ *   vesc.setSerialPort(peer.port());
+ *
+ * Over a pty or any other Stream, serve() answers what arrived on it:
+ *
+ *   int fd = port.openPty(115200);     // LinuxSerial used by VescUart
+ *   FdStream side(fd);
+ *   while (running) peer.serve(side);
+ *
+ * Faults are injected into the replies at a rate per 1000 frames, chosen by a
+ * seeded generator so a failing run can be repeated.
+ */
+
+#include "VescHost.h"
+#include "VescUart.h"
+#include <deque>
+#include <vector>
+
+// Largest reply payload, file and firmware chunks go beyond 256 bytes
+#ifndef VESC_SIM_REPLY_MAX
+#define VESC_SIM_REPLY_MAX 1024
+#endif
+
+class VescSimPeer
+{
+public:
+	/** COMM_GET_VALUES fields, in wire order */
+	struct values_t
+	{
+		float temp_fet;
+		float temp_motor;
+		float current_motor;
+		float current_in;
+		float id;
+		float iq;
+		float duty;
+		float rpm;
+		float v_in;
+		float amp_hours;
+		float amp_hours_charged;
+		float watt_hours;
+		float watt_hours_charged;
+		int32_t tachometer;
+		int32_t tachometer_abs;
+		uint8_t fault;
+		float pid_pos;
+		uint8_t controller_id;
+	};
+
+	/** Injected into replies, rates are per 1000 frames */
+	struct faults_t
+	{
+		uint16_t drop;
+		uint16_t corrupt;		// one bit flipped, the CRC no longer matches
+		uint16_t duplicate;
+		uint16_t delay;
+		uint16_t split;			// a gap in the middle of the frame
+		uint32_t delay_us;
+		uint32_t split_gap_us;
+	};
+
+	struct stats_t
+	{
+		uint32_t requests;
+		uint32_t replies;
+		uint32_t bad_frames;	// requests with a wrong CRC or end byte
+		uint32_t dropped;
+		uint32_t corrupted;
+		uint32_t duplicated;
+		uint32_t delayed;
+		uint32_t split;
+	};
+
+	// Package state, set freely between requests
+	bool ready;
+	uint8_t protocolVersion;	// 0 answers ready only, like packages before the handshake
+	uint16_t capabilities;		// esp_capability bits
+	VescUart::soundData_t sound;
+	VescUart::advancedData_t advanced;
+	uint8_t soundTriggered;
+	uint8_t enableItemData;
+	values_t values;
+
+	VescSimPeer(uint32_t baud = 115200, uint32_t processing_us = 200)
+		: ready(true), protocolVersion(1), capabilities(ESP_CAP_BUNDLE | ESP_CAP_SOUND_COMPACT),
+		  sound(), advanced(), soundTriggered(0), enableItemData(0), values(),
+		  link(this), processingUs(processing_us), faults(), random(1), stats(), extension(NULL),
+		  extensionContext(NULL), rxFree(0), txFree(0)
+	{
+		setBaud(baud);
+	}
+
+	VescSimPeer(const VescSimPeer &) = delete;
+	VescSimPeer &operator=(const VescSimPeer &) = delete;
+
+	/** 0 sends without wire time */
+	void setBaud(uint32_t baud) { byteNs = baud > 0 ? 10000000000ULL / baud : 0; }
+
+	/** Time between the end of a request and the start of its reply */
+	void setProcessingDelay(uint32_t us) { processingUs = us; }
+
+	void setFaults(const faults_t &f, uint32_t seed = 1)
+	{
+		faults = f;
+		random = seed != 0 ? seed : 1;
+	}
+
+	const stats_t &get_stats(void) const { return stats; }
+
+	/**
+	 * Answers the packets the peer does not know itself (configuration, file,
+	 * firmware, ...). payload starts at the packet id, after any CAN prefix.
+	 * Append the reply at *index, which already holds the packet id; return
+	 * false to stay silent
+	 */
+	typedef bool (*handler_t)(void *context, const uint8_t *payload, size_t len, uint8_t *reply, int32_t *index);
+
+	void setHandler(handler_t handler, void *context)
+	{
+		extension = handler;
+		extensionContext = context;
+	}
+
+	/**
+	 * Send a frame on its own, like COMM_PRINT or a log row. Called from a
+	 * handler it goes out ahead of the reply
+	 */
+	void notify(const uint8_t *payload, size_t len)
+	{
+		uint8_t frame[VESC_SIM_REPLY_MAX];
+		memcpy(frame, payload, len);
+		send(frame, len);
+	}
+
+	/** In-memory end of the link, for VescUart::setSerialPort() */
+	Stream *port(void) { return &link; }
+
+	/** Read the requests waiting on io and write the reply bytes that are due */
+	void serve(Stream &io)
+	{
+		uint8_t block[64];
+		int n;
+		while ((n = io.available()) > 0)
+		{
+			size_t got = io.readBytes(block, n < (int)sizeof(block) ? n : sizeof(block));
+			if (got == 0)
+				break;
+			receive(block, got);
+		}
+
+		while ((n = pending()) > 0)
+		{
+			size_t got = take(block, n < (int)sizeof(block) ? n : sizeof(block));
+			io.write(block, got);
+		}
+	}
+
+	/** Reply bytes due by now */
+	int pending(void)
+	{
+		uint64_t now = nowNs();
+		int n = 0;
+		for (size_t i = 0; i < tx.size() && tx[i].due <= now; i++)
+			n++;
+		return n;
+	}
+
+	/** Time of the next reply byte in us, 0 when nothing is queued */
+	uint64_t next_due_us(void) const { return tx.empty() ? 0 : tx.front().due / 1000; }
+
+private:
+	class Link : public Stream
+	{
+	public:
+		explicit Link(VescSimPeer *peer) : peer(peer) {}
+
+		int available(void) override { return peer->pending(); }
+		int read(void) override
+		{
+			uint8_t c;
+			return readBytes(&c, 1) == 1 ? c : -1;
+		}
+		int peek(void) override { return -1; }
+		size_t readBytes(uint8_t *buffer, size_t length) override { return peer->take(buffer, length); }
+
+		size_t write(uint8_t c) override { return write(&c, 1); }
+		size_t write(const uint8_t *buffer, size_t size) override
+		{
+			peer->receive(buffer, size);
+			return size;
+		}
+
+		using Stream::readBytes;
+		using Print::write;
+
+	private:
+		VescSimPeer *peer;
+	};
+
+	struct txByte_t
+	{
+		uint64_t due;
+		uint8_t byte;
+	};
+
+	static uint64_t nowNs(void) { return vesc_host_clock().now_us() * 1000; }
+
+	size_t take(uint8_t *buffer, size_t length)
+	{
+		uint64_t now = nowNs();
+		size_t n = 0;
+		while (n < length && !tx.empty() && tx.front().due <= now)
+		{
+			buffer[n++] = tx.front().byte;
+			tx.pop_front();
+		}
+		return n;
+	}
+
+	void receive(const uint8_t *data, size_t len)
+	{
+		// The bytes cross the wire one after another from now on
+		uint64_t now = nowNs();
+		if (rxFree < now)
+			rxFree = now;
+
+		for (size_t i = 0; i < len; i++)
+		{
+			rxFree += byteNs;
+			rx.push_back(data[i]);
+			parse();
+		}
+	}
+
+	void parse(void)
+	{
+		while (!rx.empty())
+		{
+			if (rx[0] != 2 && rx[0] != 3)
+			{
+				rx.erase(rx.begin());
+				continue;
+			}
+
+			size_t header = rx[0] == 2 ? 2 : 3;
+			if (rx.size() < header)
+				return;
+			size_t len = header == 2 ? rx[1] : (size_t)(rx[1] << 8 | rx[2]);
+			if (rx.size() < header + len + 3)
+				return;
+
+			uint8_t *payload = &rx[header];
+			uint16_t crc = (uint16_t)(payload[len] << 8 | payload[len + 1]);
+			if (payload[len + 2] != 3 || crc != crc16(payload, len))
+			{
+				// Not a frame after all, look for the next start byte
+				stats.bad_frames++;
+				rx.erase(rx.begin());
+				continue;
+			}
+
+			stats.requests++;
+			handle(payload, len);
+			rx.erase(rx.begin(), rx.begin() + header + len + 3);
+		}
+	}
+
+	void handle(const uint8_t *payload, size_t len)
+	{
+		// Forwarded requests are answered as if the CAN device did
+		if (len >= 2 && payload[0] == COMM_FORWARD_CAN)
+		{
+			payload += 2;
+			len -= 2;
+		}
+		if (len == 0)
+			return;
+
+		uint8_t reply[VESC_SIM_REPLY_MAX];
+		int32_t index = 0;
+		reply[index++] = payload[0];
+
+		switch (payload[0])
+		{
+		case COMM_GET_VALUES:
+			appendValues(reply, &index, 0x3FFFF);
+			break;
+
+		case COMM_GET_VALUES_SELECTIVE:
+		{
+			if (len < 5)
+				return;
+			int32_t i = 1;
+			uint32_t mask = buffer_get_uint32(payload, &i);
+			buffer_append_uint32(reply, mask, &index);
+			appendValues(reply, &index, mask);
+			break;
+		}
+
+		case COMM_CUSTOM_APP_DATA:
+			if (len < 3 || payload[1] != ESP32_COMMAND_ID || !handleEsp(payload, len, reply, &index))
+				return;
+			break;
+
+		default:
+			if (extension == NULL || !extension(extensionContext, payload, len, reply, &index))
+				return;
+			break;
+		}
+
+		send(reply, index);
+	}
+
+	// Reference responder of the float package, false when it stays silent
+	bool handleEsp(const uint8_t *payload, size_t len, uint8_t *reply, int32_t *index)
+	{
+		reply[(*index)++] = ESP32_COMMAND_ID;
+		reply[(*index)++] = payload[2];
+
+		switch (payload[2])
+		{
+		case ESP_COMMAND_GET_READY:
+			reply[(*index)++] = ready;
+			if (protocolVersion > 0)
+			{
+				reply[(*index)++] = protocolVersion;
+				buffer_append_uint16(reply, capabilities, index);
+			}
+			return true;
+
+		case ESP_COMMAND_GET_ADV_INFO:
+			VescUart::advancedLayout::pack(advanced, reply, index);
+			return true;
+
+		case ESP_COMMAND_ENGINE_SOUND_INFO:
+			VescUart::soundLayout::pack(sound, reply, index);
+			return true;
+
+		case ESP_COMMAND_SOUND_GET:
+			reply[(*index)++] = soundTriggered;
+			return true;
+
+		case ESP_COMMAND_SOUND_SET:
+			if (len >= 4)
+				soundTriggered = payload[3];
+			return false;
+
+		case ESP_COMMAND_ENABLE_ITEM_INFO:
+			reply[(*index)++] = enableItemData;
+			return true;
+
+		case ESP_COMMAND_GET_BUNDLE:
+			if (!(capabilities & ESP_CAP_BUNDLE))
+				return false;
+			VescUart::soundLayout::pack(sound, reply, index);
+			reply[(*index)++] = soundTriggered;
+			reply[(*index)++] = enableItemData;
+			return true;
+
+		case ESP_COMMAND_ENGINE_SOUND_COMPACT:
+			if (!(capabilities & ESP_CAP_SOUND_COMPACT))
+				return false;
+			buffer_append_float16(reply, sound.pidOutput, 1e2, index);
+			reply[(*index)++] = sound.swState;
+			buffer_append_varint(reply, (int32_t)sound.erpm, index);
+			buffer_append_float16(reply, sound.inputVoltage, 1e2, index);
+			buffer_append_float16(reply, sound.motorCurrent, 1e1, index);
+			return true;
+
+		default:
+			return false;
+		}
+	}
+
+	void appendValues(uint8_t *buffer, int32_t *index, uint32_t mask)
+	{
+		const values_t &v = values;
+		if (mask & (1 << 0)) buffer_append_float16(buffer, v.temp_fet, 1e1, index);
+		if (mask & (1 << 1)) buffer_append_float16(buffer, v.temp_motor, 1e1, index);
+		if (mask & (1 << 2)) buffer_append_float32(buffer, v.current_motor, 1e2, index);
+		if (mask & (1 << 3)) buffer_append_float32(buffer, v.current_in, 1e2, index);
+		if (mask & (1 << 4)) buffer_append_float32(buffer, v.id, 1e2, index);
+		if (mask & (1 << 5)) buffer_append_float32(buffer, v.iq, 1e2, index);
+		if (mask & (1 << 6)) buffer_append_float16(buffer, v.duty, 1e3, index);
+		if (mask & (1 << 7)) buffer_append_float32(buffer, v.rpm, 1e0, index);
+		if (mask & (1 << 8)) buffer_append_float16(buffer, v.v_in, 1e1, index);
+		if (mask & (1 << 9)) buffer_append_float32(buffer, v.amp_hours, 1e4, index);
+		if (mask & (1 << 10)) buffer_append_float32(buffer, v.amp_hours_charged, 1e4, index);
+		if (mask & (1 << 11)) buffer_append_float32(buffer, v.watt_hours, 1e4, index);
+		if (mask & (1 << 12)) buffer_append_float32(buffer, v.watt_hours_charged, 1e4, index);
+		if (mask & (1 << 13)) buffer_append_int32(buffer, v.tachometer, index);
+		if (mask & (1 << 14)) buffer_append_int32(buffer, v.tachometer_abs, index);
+		if (mask & (1 << 15)) buffer[(*index)++] = v.fault;
+		if (mask & (1 << 16)) buffer_append_float32(buffer, v.pid_pos, 1e6, index);
+		if (mask & (1 << 17)) buffer[(*index)++] = v.controller_id;
+	}
+
+	bool roll(uint16_t rate)
+	{
+		if (rate == 0)
+			return false;
+
+		// xorshift32
+		random ^= random << 13;
+		random ^= random >> 17;
+		random ^= random << 5;
+		return random % 1000 < rate;
+	}
+
+	void send(uint8_t *payload, int len)
+	{
+		std::vector<uint8_t> frame;
+		if (len <= 255)
+		{
+			frame.push_back(2);
+			frame.push_back(len);
+		}
+		else
+		{
+			frame.push_back(3);
+			frame.push_back((uint8_t)(len >> 8));
+			frame.push_back((uint8_t)(len & 0xFF));
+		}
+		frame.insert(frame.end(), payload, payload + len);
+		uint16_t crc = crc16(payload, len);
+		frame.push_back((uint8_t)(crc >> 8));
+		frame.push_back((uint8_t)(crc & 0xFF));
+		frame.push_back(3);
+
+		if (roll(faults.drop))
+		{
+			stats.dropped++;
+			return;
+		}
+
+		if (roll(faults.corrupt))
+		{
+			stats.corrupted++;
+			frame[frame.size() - len - 3 + random % len] ^= 1 << (random % 8);
+		}
+
+		uint64_t start = rxFree + (uint64_t)processingUs * 1000;
+		if (roll(faults.delay))
+		{
+			stats.delayed++;
+			start += (uint64_t)faults.delay_us * 1000;
+		}
+
+		size_t splitAt = frame.size();
+		if (roll(faults.split))
+		{
+			stats.split++;
+			splitAt = frame.size() / 2;
+		}
+
+		int copies = 1;
+		if (roll(faults.duplicate))
+		{
+			stats.duplicated++;
+			copies = 2;
+		}
+
+		if (txFree < start)
+			txFree = start;
+
+		for (int c = 0; c < copies; c++)
+		{
+			for (size_t i = 0; i < frame.size(); i++)
+			{
+				if (i == splitAt)
+					txFree += (uint64_t)faults.split_gap_us * 1000;
+				txFree += byteNs;
+				txByte_t b = {txFree, frame[i]};
+				tx.push_back(b);
+			}
+		}
+
+		stats.replies++;
+	}
+
+	Link link;
+	uint64_t byteNs;
+	uint32_t processingUs;
+	faults_t faults;
+	uint32_t random;
+	stats_t stats;
+	handler_t extension;
+	void *extensionContext;
+
+	std::vector<uint8_t> rx;
+	std::deque<txByte_t> tx;
+	uint64_t rxFree;	// when the last request byte has arrived, ns
+	uint64_t txFree;	// when the last reply byte has left, ns
+};
+
+#endif /* VESC_SIM_PEER_H_ */
@@ -0,0 +1,92 @@
+#include "linering.h"
+#include <stddef.h>
+
+// Lines are stored with a 0 terminator, a line longer than the ring is cut.
+
+void line_ring_init(line_ring *ring, char *buf, uint16_t size) {
+	ring->buf = buf;
+	ring->size = size;
+	ring->head = 0;
+	ring->tail = 0;
+	ring->used = 0;
+	ring->dropped = 0;
+}
+
+static void line_ring_drop_oldest(line_ring *ring) {
+	while (ring->used > 0) {
+		char c = ring->buf[ring->tail];
+		ring->tail = (ring->tail + 1) % ring->size;
+		ring->used--;
+		if (c == 0) {
+			break;
+		}
+	}
+	ring->dropped++;
+}
+
+void line_ring_push(line_ring *ring, const char *line, uint16_t len) {
+	if (ring->buf == NULL || ring->size < 2) {
+		return;
+	}
+
+	// Stop at a terminator and drop trailing new lines, the terminator separates lines
+	for (uint16_t i = 0; i < len; i++) {
+		if (line[i] == 0) {
+			len = i;
+			break;
+		}
+	}
+
+	while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r')) {
+		len--;
+	}
+
+	if (len > ring->size - 1) {
+		len = ring->size - 1;
+	}
+
+	while (ring->size - ring->used < len + 1) {
+		line_ring_drop_oldest(ring);
+	}
+
+	for (uint16_t i = 0; i < len; i++) {
+		ring->buf[ring->head] = line[i];
+		ring->head = (ring->head + 1) % ring->size;
+	}
+	ring->buf[ring->head] = 0;
+	ring->head = (ring->head + 1) % ring->size;
+	ring->used += len + 1;
+}
+
+int line_ring_pop(line_ring *ring, char *line, uint16_t size) {
+	if (ring->used == 0 || size == 0) {
+		return -1;
+	}
+
+	uint16_t len = 0;
+	while (ring->used > 0) {
+		char c = ring->buf[ring->tail];
+		ring->tail = (ring->tail + 1) % ring->size;
+		ring->used--;
+
+		if (c == 0) {
+			break;
+		}
+		if (len < size - 1) {
+			line[len++] = c;
+		}
+	}
+	line[len] = 0;
+
+	return len;
+}
+
+uint16_t line_ring_lines(const line_ring *ring) {
+	uint16_t lines = 0;
+	for (uint16_t i = 0, pos = ring->tail; i < ring->used; i++, pos = (pos + 1) % ring->size) {
+		if (ring->buf[pos] == 0) {
+			lines++;
+		}
+	}
+	return lines;
+}
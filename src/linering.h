@@ -0,0 +1,24 @@
+#ifndef LINERING_H_
+#define LINERING_H_
+
+#include <stdint.h>
+
+/*
+ * Bounded ring of text lines. Pushing never blocks: when a line does not fit,
+ * the oldest lines are dropped to make room and counted in dropped.
+ */
+typedef struct {
+	char *buf;
+	uint16_t size;
+	uint16_t head;		// next byte written
+	uint16_t tail;		// oldest byte
+	uint16_t used;
+	uint32_t dropped;	// lines lost to overflow
+} line_ring;
+
+void line_ring_init(line_ring *ring, char *buf, uint16_t size);
+void line_ring_push(line_ring *ring, const char *line, uint16_t len);
+int line_ring_pop(line_ring *ring, char *line, uint16_t size);
+uint16_t line_ring_lines(const line_ring *ring);
+
+#endif /* LINERING_H_ */
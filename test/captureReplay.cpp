@@ -0,0 +1,109 @@
+/**
+ * Host round trip of setCapture() and VescReplay: a session against
+ * VescSimPeer with dropped, delayed and split replies is captured, then the
+ * same calls are made again on the capture, at full speed and at the recorded
+ * timing. Every call must come out as it did live, failures included, which
+ * needs each reply held back until its request was written. With duplicated
+ * replies as well, the full speed replay must still match; at the recorded
+ * timing, whether a copy is dropped before the next request is a race decided
+ * by microseconds, so that one is not compared.
+ */
+
+// g++ -std=gnu++11 -Isrc/host -Isrc test/captureReplay.cpp src/*.cpp -o captureReplay && ./captureReplay
+
+#include "VescSimPeer.h"
+#include "VescReplay.h"
+#include "check.h"
+
+#define CALLS 300
+
+struct result_t
+{
+	bool ok;
+	float value; // erpm after soundUpdate(), volume after advancedUpdate()
+};
+
+/** The calls of the session, the same live and on the replay */
+static void session(VescUart &vesc, VescSimPeer *peer, result_t *results)
+{
+	CHECK(vesc.get_vesc_ready());
+
+	for (int i = 0; i < CALLS; i++)
+	{
+		if (peer != NULL)
+		{
+			peer->sound.erpm = 1000 + i;
+			peer->advanced.engine_sound_volume = i % 100;
+		}
+
+		result_t &r = results[i];
+		if (i % 3 == 2)
+		{
+			r.ok = vesc.advancedUpdate();
+			r.value = r.ok ? vesc.get_engine_sound_volume() : 0;
+		}
+		else
+		{
+			r.ok = vesc.soundUpdate();
+			r.value = r.ok ? vesc.get_erpm() : 0;
+		}
+	}
+}
+
+static void roundTrip(const VescSimPeer::faults_t &faults, bool realtime)
+{
+	static LoopbackStream<65536> capture; // without a peer it reads back what was written
+	static result_t live[CALLS];
+	static result_t replayed[CALLS];
+
+	VirtualClock::install(0, 1);
+
+	VescSimPeer peer(115200, 200);
+	peer.setFaults(faults, 7);
+
+	VescUart recorder(100);
+	recorder.setSerialPort(peer.port());
+	recorder.setCapture(&capture);
+	session(recorder, &peer, live);
+	recorder.setCapture(NULL);
+
+	int ok = 0;
+	for (int i = 0; i < CALLS; i++)
+		ok += live[i].ok;
+	CHECK(capture.get_dropped() == 0);
+	CHECK(peer.get_stats().dropped > 0); // some calls did fail
+	CHECK(ok > CALLS * 9 / 10 && ok < CALLS);
+
+	VescReplay replay;
+	CHECK(replay.begin(&capture, realtime));
+	// The session starts with a request, nothing may be read before it
+	CHECK(replay.available() == 0);
+
+	VescUart player(100);
+	player.setSerialPort(&replay);
+	session(player, NULL, replayed);
+
+	int differ = 0;
+	for (int i = 0; i < CALLS; i++)
+		differ += live[i].ok != replayed[i].ok || live[i].value != replayed[i].value;
+	CHECK(differ == 0);
+	CHECK(replay.done());
+}
+
+int main()
+{
+	VescSimPeer::faults_t faults = {};
+	faults.drop = 30;
+	faults.delay = 30;
+	faults.split = 30;
+	faults.delay_us = 5000;
+	faults.split_gap_us = 2000;
+
+	roundTrip(faults, false);
+	roundTrip(faults, true);
+
+	faults.duplicate = 30;
+	roundTrip(faults, false);
+
+	return report();
+}
@@ -0,0 +1,30 @@
+#ifndef CHECK_H_
+#define CHECK_H_
+
+/*
+ * Checks shared by the host tests. CHECK() prints the failed condition and
+ * counts it, main() ends with return report();
+ */
+
+#include <stdio.h>
+
+static int failures = 0;
+
+#define CHECK(cond)                                                  \
+	do                                                               \
+	{                                                                \
+		if (!(cond))                                                 \
+		{                                                            \
+			printf("%s:%d: %s failed\n", __FILE__, __LINE__, #cond); \
+			failures++;                                              \
+		}                                                            \
+	} while (0)
+
+/** One line verdict, and the exit code of the test */
+static int report(void)
+{
+	printf("%s: %d failure(s)\n", failures ? "FAIL" : "OK", failures);
+	return failures ? 1 : 0;
+}
+
+#endif /* CHECK_H_ */
@@ -0,0 +1,401 @@
+/**
+ * Host round trip of getMcconf() / getAppconf(): an mc_configuration and an
+ * app_configuration are serialised in the order and with the wire types of
+ * confgenerator.c for the datatypes.h of this library, served by VescSimPeer
+ * and read back with field tables at the offsets that layout gives. Corrupted
+ * frames, a wrong signature and a short configuration must leave the
+ * destinations untouched, terminal output sent ahead of the reply must not.
+ */
+
+// g++ -std=gnu++11 -Isrc/host -Isrc test/confRoundTrip.cpp src/*.cpp -o confRoundTrip && ./confRoundTrip
+
+#include "VescSimPeer.h"
+#include "check.h"
+
+// Stand-ins for MCCONF_SIGNATURE / APPCONF_SIGNATURE of the firmware
+#define MCCONF_SIGNATURE 0x4D43F00Du
+#define APPCONF_SIGNATURE 0x41505043u
+
+// A serialised configuration as the firmware sends it
+struct reference_t
+{
+	uint8_t data[600];
+	int32_t len;
+	uint8_t packetId;
+	VescSimPeer *peer;
+	const char *print;	// sent as COMM_PRINT ahead of the reply
+};
+
+static bool serveConf(void *context, const uint8_t *payload, size_t len, uint8_t *reply, int32_t *index)
+{
+	reference_t *ref = (reference_t *)context;
+	if (len != 1 || payload[0] != ref->packetId)
+		return false;
+	if (ref->print != NULL)
+	{
+		uint8_t print[64] = {COMM_PRINT};
+		size_t printLen = strlen(ref->print);
+		memcpy(print + 1, ref->print, printLen);
+		ref->peer->notify(print, printLen + 1);
+	}
+	memcpy(reply + *index, ref->data, ref->len);
+	*index += ref->len;
+	return true;
+}
+
+/**
+ * Start of confgenerator_serialize_mcconf(): signature, motor type, limits,
+ * sensorless and hall settings. FOC, PID, misc, setup info and BMS follow on
+ * the wire; they are not read here and go out as zeros, so the frame still
+ * has the length of a whole configuration.
+ */
+static void serializeMcconf(reference_t *ref, const mc_configuration &conf)
+{
+	uint8_t *buffer = ref->data;
+	int32_t ind = 0;
+
+	buffer_append_uint32(buffer, MCCONF_SIGNATURE, &ind);
+	buffer[ind++] = conf.pwm_mode;
+	buffer[ind++] = conf.comm_mode;
+	buffer[ind++] = conf.motor_type;
+	buffer[ind++] = conf.sensor_mode;
+	buffer_append_float32_auto(buffer, conf.l_current_max, &ind);
+	buffer_append_float32_auto(buffer, conf.l_current_min, &ind);
+	buffer_append_float32_auto(buffer, conf.l_in_current_max, &ind);
+	buffer_append_float32_auto(buffer, conf.l_in_current_min, &ind);
+	buffer_append_float32_auto(buffer, conf.l_abs_current_max, &ind);
+	buffer_append_float32_auto(buffer, conf.l_min_erpm, &ind);
+	buffer_append_float32_auto(buffer, conf.l_max_erpm, &ind);
+	buffer_append_float16(buffer, conf.l_erpm_start, 10000, &ind);
+	buffer_append_float32_auto(buffer, conf.l_max_erpm_fbrake, &ind);
+	buffer_append_float32_auto(buffer, conf.l_max_erpm_fbrake_cc, &ind);
+	buffer_append_float16(buffer, conf.l_min_vin, 10, &ind);
+	buffer_append_float16(buffer, conf.l_max_vin, 10, &ind);
+	buffer_append_float16(buffer, conf.l_battery_cut_start, 10, &ind);
+	buffer_append_float16(buffer, conf.l_battery_cut_end, 10, &ind);
+	buffer[ind++] = conf.l_slow_abs_current;
+	buffer_append_float16(buffer, conf.l_temp_fet_start, 10, &ind);
+	buffer_append_float16(buffer, conf.l_temp_fet_end, 10, &ind);
+	buffer_append_float16(buffer, conf.l_temp_motor_start, 10, &ind);
+	buffer_append_float16(buffer, conf.l_temp_motor_end, 10, &ind);
+	buffer_append_float16(buffer, conf.l_temp_accel_dec, 10000, &ind);
+	buffer_append_float16(buffer, conf.l_min_duty, 10000, &ind);
+	buffer_append_float16(buffer, conf.l_max_duty, 10000, &ind);
+	buffer_append_float32_auto(buffer, conf.l_watt_max, &ind);
+	buffer_append_float32_auto(buffer, conf.l_watt_min, &ind);
+	buffer_append_float16(buffer, conf.l_current_max_scale, 10000, &ind);
+	buffer_append_float16(buffer, conf.l_current_min_scale, 10000, &ind);
+	buffer_append_float16(buffer, conf.l_duty_start, 10000, &ind);
+	buffer_append_float32_auto(buffer, conf.sl_min_erpm, &ind);
+	buffer_append_float32_auto(buffer, conf.sl_min_erpm_cycle_int_limit, &ind);
+	buffer_append_float32_auto(buffer, conf.sl_max_fullbreak_current_dir_change, &ind);
+	buffer_append_float32_auto(buffer, conf.sl_cycle_int_limit, &ind);
+	buffer_append_float32_auto(buffer, conf.sl_phase_advance_at_br, &ind);
+	buffer_append_float32_auto(buffer, conf.sl_cycle_int_rpm_br, &ind);
+	buffer_append_float32_auto(buffer, conf.sl_bemf_coupling_k, &ind);
+	for (int i = 0; i < 8; i++)
+		buffer[ind++] = (uint8_t)conf.hall_table[i];
+	buffer_append_float32_auto(buffer, conf.hall_sl_erpm, &ind);
+
+	ref->len = 480;
+	memset(buffer + ind, 0, ref->len - ind);
+	ref->packetId = COMM_GET_MCCONF;
+}
+
+/** Start of confgenerator_serialize_appconf(), up to the app in use */
+static void serializeAppconf(reference_t *ref, const app_configuration &conf)
+{
+	uint8_t *buffer = ref->data;
+	int32_t ind = 0;
+
+	buffer_append_uint32(buffer, APPCONF_SIGNATURE, &ind);
+	buffer[ind++] = conf.controller_id;
+	buffer_append_uint32(buffer, conf.timeout_msec, &ind);
+	buffer_append_float32_auto(buffer, conf.timeout_brake_current, &ind);
+	buffer_append_uint16(buffer, conf.can_status_rate_1, &ind);
+	buffer[ind++] = conf.can_status_msgs_r1;
+	buffer_append_uint16(buffer, conf.can_status_rate_2, &ind);
+	buffer[ind++] = conf.can_status_msgs_r2;
+	buffer[ind++] = conf.can_baud_rate;
+	buffer[ind++] = conf.pairing_done;
+	buffer[ind++] = conf.permanent_uart_enabled;
+	buffer[ind++] = conf.shutdown_mode;
+	buffer[ind++] = conf.servo_out_enable;
+	buffer[ind++] = conf.kill_sw_mode;
+	buffer[ind++] = conf.can_mode;
+	buffer[ind++] = conf.uavcan_esc_index;
+	buffer[ind++] = conf.uavcan_raw_mode;
+	buffer_append_float32_auto(buffer, conf.uavcan_raw_rpm_max, &ind);
+	buffer[ind++] = conf.uavcan_status_current_mode;
+	buffer[ind++] = conf.app_to_use;
+
+	ref->len = 400;
+	memset(buffer + ind, 0, ref->len - ind);
+	ref->packetId = COMM_GET_APPCONF;
+}
+
+static mc_configuration mcconf(void)
+{
+	mc_configuration conf;
+	memset(&conf, 0, sizeof(conf));
+	conf.pwm_mode = PWM_MODE_SYNCHRONOUS;
+	conf.comm_mode = COMM_MODE_INTEGRATE;
+	conf.motor_type = MOTOR_TYPE_FOC;
+	conf.sensor_mode = SENSOR_MODE_SENSORLESS;
+	conf.l_current_max = 95.5f;
+	conf.l_current_min = -80.0f;
+	conf.l_in_current_max = 60.0f;
+	conf.l_in_current_min = -45.0f;
+	conf.l_abs_current_max = 150.0f;
+	conf.l_min_erpm = -100000.0f;
+	conf.l_max_erpm = 100000.0f;
+	conf.l_erpm_start = 0.8f;
+	conf.l_max_erpm_fbrake = 300.0f;
+	conf.l_max_erpm_fbrake_cc = 1500.0f;
+	conf.l_min_vin = 8.0f;
+	conf.l_max_vin = 57.0f;
+	conf.l_battery_cut_start = 42.5f;
+	conf.l_battery_cut_end = 40.0f;
+	conf.l_slow_abs_current = true;
+	conf.l_temp_fet_start = 85.0f;
+	conf.l_temp_fet_end = 100.0f;
+	conf.l_temp_motor_start = 85.0f;
+	conf.l_temp_motor_end = 100.0f;
+	conf.l_temp_accel_dec = 0.15f;
+	conf.l_min_duty = 0.005f;
+	conf.l_max_duty = 0.95f;
+	conf.l_watt_max = 1500000.0f;
+	conf.l_watt_min = -1500000.0f;
+	conf.l_current_max_scale = 1.0f;
+	conf.l_current_min_scale = 0.9f;
+	conf.l_duty_start = 1.0f;
+	conf.sl_min_erpm = 150.0f;
+	conf.sl_min_erpm_cycle_int_limit = 1100.0f;
+	conf.sl_max_fullbreak_current_dir_change = 10.0f;
+	conf.sl_cycle_int_limit = 62.0f;
+	conf.sl_phase_advance_at_br = 0.8f;
+	conf.sl_cycle_int_rpm_br = 80000.0f;
+	conf.sl_bemf_coupling_k = 600.0f;
+	const int8_t hall[8] = {-1, 1, 3, 2, 5, 6, 4, -1};
+	memcpy(conf.hall_table, hall, sizeof(hall));
+	conf.hall_sl_erpm = 2000.0f;
+	return conf;
+}
+
+static app_configuration appconf(void)
+{
+	app_configuration conf;
+	memset(&conf, 0, sizeof(conf));
+	conf.controller_id = 42;
+	conf.timeout_msec = 1000;
+	conf.timeout_brake_current = 12.5f;
+	conf.can_status_rate_1 = 50;
+	conf.can_status_msgs_r1 = 0x0F;
+	conf.can_status_rate_2 = 5;
+	conf.can_status_msgs_r2 = 0x03;
+	conf.can_baud_rate = CAN_BAUD_500K;
+	conf.permanent_uart_enabled = true;
+	conf.can_mode = CAN_MODE_VESC;
+	conf.uavcan_esc_index = 0;
+	conf.uavcan_raw_rpm_max = 50000.0f;
+	conf.app_to_use = APP_BALANCE;
+	return conf;
+}
+
+// A selection of mcconf fields, every offset taken from the layout above
+struct mcValues_t
+{
+	uint8_t motor_type;
+	float l_current_max;
+	float l_min_erpm;
+	float l_erpm_start;
+	float l_max_vin;
+	bool l_slow_abs_current;
+	float l_temp_motor_end;
+	float l_watt_max;
+	float l_duty_start;
+	int8_t hall_table_3;
+	float hall_sl_erpm;
+};
+
+static const int MC_FIELDS = 11;
+
+static void mcFields(mcValues_t *v, VescUart::confField_t *f)
+{
+	VescUart::confField_t list[MC_FIELDS] = {
+		{6, CONF_FIELD_UINT8, 1, &v->motor_type},
+		{8, CONF_FIELD_FLOAT32_AUTO, 1, &v->l_current_max},
+		{28, CONF_FIELD_FLOAT32_AUTO, 1, &v->l_min_erpm},
+		{36, CONF_FIELD_FLOAT16, 1e4, &v->l_erpm_start},
+		{48, CONF_FIELD_FLOAT16, 1e1, &v->l_max_vin},
+		{54, CONF_FIELD_BOOL, 1, &v->l_slow_abs_current},
+		{61, CONF_FIELD_FLOAT16, 1e1, &v->l_temp_motor_end},
+		{69, CONF_FIELD_FLOAT32_AUTO, 1, &v->l_watt_max},
+		{81, CONF_FIELD_FLOAT16, 1e4, &v->l_duty_start},
+		{114, CONF_FIELD_INT8, 1, &v->hall_table_3},
+		{119, CONF_FIELD_FLOAT32_AUTO, 1, &v->hall_sl_erpm},
+	};
+	memcpy(f, list, sizeof(list));
+}
+
+// The appconf fields, and the same bytes read as the remaining wire types
+struct appValues_t
+{
+	uint8_t controller_id;
+	uint32_t timeout_msec;
+	float timeout_brake_current;
+	uint16_t can_status_rate_1;
+	uint8_t can_status_msgs_r2;
+	bool permanent_uart_enabled;
+	float uavcan_raw_rpm_max;
+	uint8_t app_to_use;
+
+	int32_t timeout_msec_i32;
+	int16_t can_status_rate_1_i16;
+	float timeout_s;	// timeout_msec as CONF_FIELD_FLOAT32 with scale 1000
+};
+
+static const int APP_FIELDS = 8;
+static const int APP_TYPE_FIELDS = 2;
+
+static void appFields(appValues_t *v, VescUart::confField_t *f, VescUart::confField_t *types, VescUart::confField_t *scaled)
+{
+	VescUart::confField_t list[APP_FIELDS] = {
+		{4, CONF_FIELD_UINT8, 1, &v->controller_id},
+		{5, CONF_FIELD_UINT32, 1, &v->timeout_msec},
+		{9, CONF_FIELD_FLOAT32_AUTO, 1, &v->timeout_brake_current},
+		{13, CONF_FIELD_UINT16, 1, &v->can_status_rate_1},
+		{18, CONF_FIELD_UINT8, 1, &v->can_status_msgs_r2},
+		{21, CONF_FIELD_BOOL, 1, &v->permanent_uart_enabled},
+		{28, CONF_FIELD_FLOAT32_AUTO, 1, &v->uavcan_raw_rpm_max},
+		{33, CONF_FIELD_UINT8, 1, &v->app_to_use},
+	};
+	memcpy(f, list, sizeof(list));
+
+	VescUart::confField_t other[APP_TYPE_FIELDS] = {
+		{5, CONF_FIELD_INT32, 1, &v->timeout_msec_i32},
+		{13, CONF_FIELD_INT16, 1, &v->can_status_rate_1_i16},
+	};
+	memcpy(types, other, sizeof(other));
+
+	VescUart::confField_t seconds = {5, CONF_FIELD_FLOAT32, 1e3, &v->timeout_s};
+	*scaled = seconds;
+}
+
+template <typename T>
+static bool untouched(const T &v)
+{
+	T blank;
+	memset(&blank, 0x5A, sizeof(blank));
+	return memcmp(&v, &blank, sizeof(v)) == 0;
+}
+
+int main()
+{
+	VirtualClock::install(0, 1);
+
+	reference_t ref = {};
+	VescSimPeer peer;
+	ref.peer = &peer;
+	peer.setHandler(serveConf, &ref);
+
+	VescUart vesc(100);
+	vesc.setSerialPort(peer.port());
+
+	const mc_configuration mc = mcconf();
+	const app_configuration app = appconf();
+
+	mcValues_t v;
+	VescUart::confField_t f[MC_FIELDS];
+	mcFields(&v, f);
+
+	appValues_t a;
+	VescUart::confField_t af[APP_FIELDS];
+	VescUart::confField_t types[APP_TYPE_FIELDS];
+	VescUart::confField_t scaled;
+	appFields(&a, af, types, &scaled);
+
+	// Every field at its place in the motor configuration
+	serializeMcconf(&ref, mc);
+	memset(&v, 0x5A, sizeof(v));
+	CHECK(vesc.getMcconf(f, MC_FIELDS, MCCONF_SIGNATURE));
+	CHECK(vesc.get_conf_signature() == MCCONF_SIGNATURE);
+	CHECK(v.motor_type == MOTOR_TYPE_FOC);
+	CHECK(v.l_current_max == mc.l_current_max);
+	CHECK(v.l_min_erpm == mc.l_min_erpm);
+	CHECK(fabsf(v.l_erpm_start - mc.l_erpm_start) < 1e-4);
+	CHECK(fabsf(v.l_max_vin - mc.l_max_vin) < 1e-1);
+	CHECK(v.l_slow_abs_current == true);
+	CHECK(fabsf(v.l_temp_motor_end - mc.l_temp_motor_end) < 1e-1);
+	CHECK(v.l_watt_max == mc.l_watt_max);
+	CHECK(fabsf(v.l_duty_start - mc.l_duty_start) < 1e-4);
+	CHECK(v.hall_table_3 == mc.hall_table[3]);
+	CHECK(v.hall_sl_erpm == mc.hall_sl_erpm);
+
+	// The app configuration, no signature check
+	serializeAppconf(&ref, app);
+	memset(&a, 0x5A, sizeof(a));
+	CHECK(vesc.getAppconf(af, APP_FIELDS));
+	CHECK(vesc.get_conf_signature() == APPCONF_SIGNATURE);
+	CHECK(a.controller_id == 42);
+	CHECK(a.timeout_msec == 1000);
+	CHECK(a.timeout_brake_current == 12.5f);
+	CHECK(a.can_status_rate_1 == 50);
+	CHECK(a.can_status_msgs_r2 == 0x03);
+	CHECK(a.permanent_uart_enabled == true);
+	CHECK(a.uavcan_raw_rpm_max == 50000.0f);
+	CHECK(a.app_to_use == APP_BALANCE);
+
+	// The other wire types over the same bytes
+	CHECK(vesc.getAppconf(types, APP_TYPE_FIELDS, APPCONF_SIGNATURE));
+	CHECK(a.timeout_msec_i32 == 1000);
+	CHECK(a.can_status_rate_1_i16 == 50);
+	CHECK(vesc.getAppconf(&scaled, 1));
+	CHECK(fabsf(a.timeout_s - 1.0f) < 1e-6);
+
+	// An MCCONF request is not answered by an APPCONF reference
+	memset(&v, 0x5A, sizeof(v));
+	CHECK(!vesc.getMcconf(f, MC_FIELDS));
+	CHECK(untouched(v));
+
+	// Wrong signature
+	serializeMcconf(&ref, mc);
+	memset(&v, 0x5A, sizeof(v));
+	CHECK(!vesc.getMcconf(f, MC_FIELDS, MCCONF_SIGNATURE + 1));
+	CHECK(untouched(v));
+
+	// Configuration ends inside the last field
+	ref.len = 121;
+	memset(&v, 0x5A, sizeof(v));
+	CHECK(!vesc.getMcconf(f, MC_FIELDS, MCCONF_SIGNATURE));
+	CHECK(untouched(v));
+
+	// A flipped bit anywhere fails the CRC and nothing is stored
+	serializeMcconf(&ref, mc);
+	VescSimPeer::faults_t faults = {};
+	faults.corrupt = 1000;
+	peer.setFaults(faults, 7);
+	for (int i = 0; i < 20; i++)
+	{
+		memset(&v, 0x5A, sizeof(v));
+		CHECK(!vesc.getMcconf(f, MC_FIELDS, MCCONF_SIGNATURE));
+		CHECK(untouched(v));
+	}
+
+	// And the link recovers afterwards
+	peer.setFaults(VescSimPeer::faults_t());
+	CHECK(vesc.getMcconf(f, MC_FIELDS, MCCONF_SIGNATURE));
+	CHECK(v.l_max_vin > 56.9f);
+
+	// Terminal output ahead of the reply is captured, the reply still read
+	static char terminal[64];
+	char line[32];
+	vesc.setTerminalStorage(terminal, sizeof(terminal));
+	ref.print = "fault logged";
+	memset(&v, 0x5A, sizeof(v));
+	CHECK(vesc.getMcconf(f, MC_FIELDS, MCCONF_SIGNATURE));
+	CHECK(v.hall_sl_erpm == mc.hall_sl_erpm);
+	CHECK(vesc.terminalReadLine(line, sizeof(line)) == 12 && strcmp(line, "fault logged") == 0);
+
+	return report();
+}
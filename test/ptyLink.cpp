@@ -0,0 +1,252 @@
+/**
+ * Host test of LinuxSerial over a pty pair: VescUart talks to the slave side
+ * through termios and epoll, VescSimPeer serves the master side from its own
+ * thread at real time. Covers the float package requests, a CAN forwarded
+ * request, frames arriving in pieces, a VESC that does not answer, and that
+ * waiting for a reply sleeps in epoll instead of spinning. VescReactor must
+ * leave a frame that arrived in part buffered and return at once, and keep
+ * sending setpoints and the keepalive of a port that receives nothing.
+ */
+
+// g++ -std=gnu++11 -pthread -Isrc/host -Isrc test/ptyLink.cpp src/*.cpp -o ptyLink && ./ptyLink
+
+#include "VescLinuxSerial.h"
+#include "VescReactor.h"
+#include "VescSimPeer.h"
+#include <atomic>
+#include <thread>
+#include <time.h>
+#include "check.h"
+
+/** VescSimPeer answering the master side of a pty until stopped */
+class PtyPeer
+{
+public:
+	VescSimPeer peer;
+
+	PtyPeer(uint32_t baud) : peer(baud, 200), running(false) {}
+	~PtyPeer() { stop(); }
+
+	void start(int master)
+	{
+		side.setFd(master);
+		running = true;
+		thread = std::thread([this] {
+			while (running)
+			{
+				peer.serve(side);
+				usleep(100);
+			}
+		});
+	}
+
+	void stop(void)
+	{
+		running = false;
+		if (thread.joinable())
+			thread.join();
+		if (side.getFd() >= 0)
+			close(side.getFd());
+		side.setFd(-1);
+	}
+
+private:
+	FdStream side;
+	std::atomic<bool> running;
+	std::thread thread;
+};
+
+static double cpuMs(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+	return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static void requests(uint32_t baud)
+{
+	LinuxSerial port;
+	int master = port.openPty(baud);
+	CHECK(master >= 0);
+	if (master < 0)
+		return;
+
+	PtyPeer sim(baud);
+	sim.peer.sound.erpm = 3200;
+	sim.peer.sound.inputVoltage = 50.5f;
+	sim.peer.advanced.engine_sound_volume = 80;
+	sim.peer.soundTriggered = 1;
+	sim.peer.enableItemData = 5;
+	sim.start(master);
+
+	VescUart vesc(200);
+	vesc.setSerialPort(&port);
+
+	CHECK(vesc.get_vesc_ready());
+	CHECK(vesc.get_protocol_version() == 1);
+	CHECK(vesc.soundUpdate());
+	CHECK(vesc.get_erpm() == 3200);
+	CHECK(vesc.get_input_voltage() > 50.4f && vesc.get_input_voltage() < 50.6f);
+	CHECK(vesc.advancedUpdate());
+	CHECK(vesc.get_engine_sound_volume() == 80);
+	CHECK(vesc.get_sound_triggered() == 1);
+	CHECK(vesc.get_enable_item_data() == 5);
+	CHECK(vesc.bundleUpdate());
+	CHECK(vesc.balanceSoundUpdate(12) == false); // no balance app, sound still read
+	CHECK(vesc.get_erpm() == 3200);
+
+	// Back to back, every reply read in blocks off the same port
+	int ok = 0;
+	for (int i = 0; i < 50; i++)
+		ok += vesc.soundUpdate();
+	CHECK(ok == 50);
+
+	sim.stop();
+	CHECK(sim.peer.get_stats().bad_frames == 0);
+}
+
+static void splitFrames(void)
+{
+	LinuxSerial port;
+	int master = port.openPty(115200);
+	CHECK(master >= 0);
+	if (master < 0)
+		return;
+
+	PtyPeer sim(115200);
+	VescSimPeer::faults_t faults = {};
+	faults.split = 1000;
+	faults.split_gap_us = 5000;
+	sim.peer.setFaults(faults);
+	sim.peer.sound.erpm = 1000;
+	sim.start(master);
+
+	VescUart vesc(200);
+	vesc.setSerialPort(&port);
+
+	int ok = 0;
+	for (int i = 0; i < 10; i++)
+		ok += vesc.soundUpdate();
+	CHECK(ok == 10);
+
+	sim.stop();
+	CHECK(sim.peer.get_stats().split >= 10);
+}
+
+static void silentVesc(void)
+{
+	LinuxSerial port;
+	int master = port.openPty(115200);
+	CHECK(master >= 0);
+	if (master < 0)
+		return;
+
+	// Nobody serves the master side: every request runs into the timeout
+	VescUart vesc(100);
+	vesc.setSerialPort(&port);
+
+	uint32_t start = millis();
+	double cpu = cpuMs();
+	CHECK(!vesc.soundUpdate());
+	double spent = cpuMs() - cpu;
+	uint32_t waited = millis() - start;
+
+	CHECK(waited >= 100 && waited < 300);
+	// Asleep in epoll_wait(), not spinning on available()
+	CHECK(spent < waited / 4.0);
+
+	close(master);
+}
+
+static void reactorSplitFrame(void)
+{
+	LinuxSerial port;
+	int master = port.openPty(115200);
+	CHECK(master >= 0);
+	if (master < 0)
+		return;
+
+	static char prints[64];
+	VescUart vesc(200);
+	vesc.setLispPrintStorage(prints, sizeof(prints));
+	VescReactor reactor;
+	CHECK(reactor.add(&vesc, &port) == 0);
+
+	// A COMM_LISP_PRINT the VESC sends on its own, in two pieces
+	uint8_t payload[] = {COMM_LISP_PRINT, 'h', 'e', 'l', 'l', 'o'};
+	uint16_t crc = crc16(payload, sizeof(payload));
+	uint8_t frame[16];
+	int len = 0;
+	frame[len++] = 2;
+	frame[len++] = sizeof(payload);
+	memcpy(frame + len, payload, sizeof(payload));
+	len += sizeof(payload);
+	frame[len++] = (uint8_t)(crc >> 8);
+	frame[len++] = (uint8_t)(crc & 0xFF);
+	frame[len++] = 3;
+
+	char line[16];
+	CHECK(write(master, frame, 5) == 5);
+	usleep(20000);
+
+	uint32_t start = millis();
+	reactor.runOnce(50);
+	CHECK(millis() - start < 20); // not held for the 200 ms timeout
+	CHECK(vesc.lispReadPrint(line, sizeof(line)) < 0);
+
+	CHECK(write(master, frame + 5, len - 5) == len - 5);
+	usleep(20000);
+	reactor.runOnce(50);
+	CHECK(vesc.lispReadPrint(line, sizeof(line)) == 5 && strcmp(line, "hello") == 0);
+
+	close(master);
+}
+
+static void reactorQuietPort(void)
+{
+	LinuxSerial port;
+	int master = port.openPty(115200);
+	CHECK(master >= 0);
+	if (master < 0)
+		return;
+
+	VescUart vesc(200);
+	VescReactor reactor;
+	CHECK(reactor.add(&vesc, &port) == 0);
+
+	// The first value goes out at once, the second waits in its slot
+	vesc.setCurrent(5.0f);
+	vesc.setCurrent(6.0f);
+
+	// Nothing ever arrives on the port
+	uint32_t start = millis();
+	while (millis() - start < 300)
+		reactor.runOnce(1000);
+	usleep(20000);
+
+	uint8_t wire[256];
+	ssize_t len = read(master, wire, sizeof(wire));
+	int currents = 0, alive = 0;
+	for (ssize_t i = 0; i + 2 < len && wire[i] == 2; i += wire[i + 1] + 5)
+	{
+		currents += wire[i + 2] == COMM_SET_CURRENT;
+		alive += wire[i + 2] == COMM_ALIVE;
+	}
+	CHECK(currents == 2);
+	CHECK(alive >= 1);
+
+	close(master);
+}
+
+int main()
+{
+	requests(115200);
+	requests(921600);
+	requests(250000); // not a standard rate, needs BOTHER
+	splitFrames();
+	silentVesc();
+	reactorSplitFrame();
+	reactorQuietPort();
+
+	return report();
+}